@@ -0,0 +1,502 @@
+#define _POSIX_C_SOURCE 200809L
+#define SHOGI_IMPLEMENTATION
+#include "./shogi.h"
+#define SHOGI_BATCH_IMPLEMENTATION
+#include "./shogi_batch.h"
+
+// Per-kernel microbenchmarks.
+// Every kernel runs over the same fixed corpus of positions. A sample repeats
+// full passes over the corpus until it takes at least the target time, and
+// the ns/op of several samples gives the mean, median and spread.
+// Results can be written as JSON and compared against a stored baseline,
+// in which case the exit code is non-zero when any kernel's median got
+// slower than the threshold allows.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define MAX_TARGETS 1024
+#define MAX_BASELINE 64
+#define MAX_NAME_SIZE 64
+
+typedef struct {
+    size_t position;
+    int32_t x, y;
+    Shogi_Color color;
+    bool is_promoted;
+} Target;
+
+typedef struct {
+    size_t position;
+    Shogi_Move move;
+} Corpus_Move;
+
+typedef struct {
+    const char *name;
+    size_t (*run)(void);
+} Kernel;
+
+typedef struct {
+    char name[MAX_NAME_SIZE];
+    double median;
+} Baseline_Entry;
+
+typedef struct {
+    size_t samples;
+    double sample_seconds;
+    const char *output_path;
+    const char *baseline_path;
+    double threshold;
+    const char *filter;
+} Config;
+
+static Config config = {
+    .samples = 10,
+    .sample_seconds = 0.02,
+    .output_path = NULL,
+    .baseline_path = NULL,
+    .threshold = 10.0,
+    .filter = NULL,
+};
+
+static const char *corpus_sfens[] = {
+    // starting position
+    SHOGI_START_SFEN,
+    // after 7g7f 3c3d
+    "lnsgkgsnl/1r5b1/pppppp1pp/6p2/9/2P6/PP1PPPPPP/1B5R1/LNSGKGSNL b -",
+    // bishops exchanged, both in hand
+    "ln1gkgsnl/1r5s1/pppppp1pp/6p2/9/2P6/PP1PPPPPP/7R1/LNSGKGSNL b Bb",
+    // castled middlegame
+    "ln1g3nl/1r1s1kgs1/p1pppp1pp/1p4p2/9/2PP3P1/PPS1PPP1P/1KG2S1R1/LN1G3NL b Bb",
+    // endgame with a dragon and a full hand
+    "l6nl/3+R1gk2/p1n1pp1p1/2pp2p1p/1p5P1/2P1P1P1P/PP1PSP3/1KG6/LN6L b 2B2G2SNr3p",
+    // sparse board with promoted pieces
+    "4k4/9/4+P4/9/2+B3+r2/9/9/4K4/9 b G2Pg",
+    // black king in check
+    "4k4/9/9/9/9/9/9/4r4/4K4 b G",
+    // white to move with pieces in hand
+    "lnsgk2nl/6g2/p1pppp1pp/9/1p7/9/PPPPPPPPP/7R1/LNSGKGSNL w RBBs",
+};
+
+#define CORPUS_SIZE (sizeof(corpus_sfens) / sizeof(corpus_sfens[0]))
+
+static Shogi corpus[CORPUS_SIZE];
+static Target targets[SHOGI_KIND_COUNT][MAX_TARGETS];
+static size_t target_counts[SHOGI_KIND_COUNT];
+static Corpus_Move board_moves[MAX_TARGETS * 8];
+static size_t board_move_count;
+static Corpus_Move drop_moves[MAX_TARGETS * 8];
+static size_t drop_move_count;
+static Shogi_Batch corpus_batch;
+
+static volatile uint64_t sink;
+
+// Folds a mask into the sink, so the compiler can't drop the work that produced it
+void consume_mask(Shogi_Mask mask) {
+    uint64_t words[(sizeof(mask) + 7) / 8] = {0};
+    memcpy(words, &mask, sizeof(mask));
+    uint64_t folded = 0;
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i) {
+        folded ^= words[i];
+    }
+    sink ^= folded;
+}
+
+size_t run_moves_at(Shogi_Kind kind) {
+    for (size_t i = 0; i < target_counts[kind]; ++i) {
+        Target *t = &targets[kind][i];
+        Shogi *shogi = &corpus[t->position];
+        Shogi_Mask mask;
+        switch (kind) {
+        case SHOGI_KING: mask = shogi_king_moves_at(shogi, t->x, t->y, t->color, false); break;
+        case SHOGI_ROOK: mask = shogi_rook_moves_at(shogi, t->x, t->y, t->color, t->is_promoted, false); break;
+        case SHOGI_BISHOP: mask = shogi_bishop_moves_at(shogi, t->x, t->y, t->color, t->is_promoted, false); break;
+        case SHOGI_GOLD: mask = shogi_gold_moves_at(shogi, t->x, t->y, t->color, false); break;
+        case SHOGI_SILVER: mask = shogi_silver_moves_at(shogi, t->x, t->y, t->color, t->is_promoted, false); break;
+        case SHOGI_KNIGHT: mask = shogi_knight_moves_at(shogi, t->x, t->y, t->color, t->is_promoted, false); break;
+        case SHOGI_LANCE: mask = shogi_lance_moves_at(shogi, t->x, t->y, t->color, t->is_promoted, false); break;
+        case SHOGI_PAWN: mask = shogi_pawn_moves_at(shogi, t->x, t->y, t->color, t->is_promoted, false); break;
+        default: assert(0 && "unreachable");
+        }
+        consume_mask(mask);
+    }
+    return target_counts[kind];
+}
+
+size_t run_king_moves_at(void) { return run_moves_at(SHOGI_KING); }
+size_t run_rook_moves_at(void) { return run_moves_at(SHOGI_ROOK); }
+size_t run_bishop_moves_at(void) { return run_moves_at(SHOGI_BISHOP); }
+size_t run_gold_moves_at(void) { return run_moves_at(SHOGI_GOLD); }
+size_t run_silver_moves_at(void) { return run_moves_at(SHOGI_SILVER); }
+size_t run_knight_moves_at(void) { return run_moves_at(SHOGI_KNIGHT); }
+size_t run_lance_moves_at(void) { return run_moves_at(SHOGI_LANCE); }
+size_t run_pawn_moves_at(void) { return run_moves_at(SHOGI_PAWN); }
+
+// The dispatching entry point the GUI and move generation go through
+size_t run_piece_moves_at(void) {
+    size_t ops = 0;
+    for (size_t kind = 0; kind < SHOGI_KIND_COUNT; ++kind) {
+        for (size_t i = 0; i < target_counts[kind]; ++i) {
+            Target *t = &targets[kind][i];
+            consume_mask(shogi_piece_moves_at(&corpus[t->position], t->x, t->y, false));
+        }
+        ops += target_counts[kind];
+    }
+    return ops;
+}
+
+size_t run_drop_piece_locations(void) {
+    size_t ops = 0;
+    for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+        for (size_t color = 0; color < SHOGI_COLOR_COUNT; ++color) {
+            for (Shogi_Kind kind = SHOGI_ROOK; kind < SHOGI_KIND_COUNT; ++kind) {
+                consume_mask(shogi_drop_piece_locations(&corpus[i], color, kind));
+                ops += 1;
+            }
+        }
+    }
+    return ops;
+}
+
+size_t run_color_moves(void) {
+    for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+        consume_mask(shogi_color_moves(&corpus[i], SHOGI_BLACK, true));
+        consume_mask(shogi_color_moves(&corpus[i], SHOGI_WHITE, true));
+    }
+    return CORPUS_SIZE * SHOGI_COLOR_COUNT;
+}
+
+size_t run_find_king(void) {
+    for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+        for (size_t color = 0; color < SHOGI_COLOR_COUNT; ++color) {
+            size_t x = 0, y = 0;
+            shogi_find_king(&corpus[i], color, &x, &y);
+            sink ^= x * SHOGI_BOARD_DIM + y;
+        }
+    }
+    return CORPUS_SIZE * SHOGI_COLOR_COUNT;
+}
+
+size_t run_legal_moves(void) {
+    Shogi_Move moves[SHOGI_MAX_MOVES];
+    for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+        sink ^= shogi_legal_moves(&corpus[i], moves, SHOGI_MAX_MOVES);
+    }
+    return CORPUS_SIZE;
+}
+
+size_t run_sfen_load(void) {
+    for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+        Shogi shogi = {0};
+        sink ^= shogi_load_from_sfen(&shogi, corpus_sfens[i]);
+        sink ^= shogi.turn;
+    }
+    return CORPUS_SIZE;
+}
+
+size_t run_move_piece(void) {
+    for (size_t i = 0; i < board_move_count; ++i) {
+        Corpus_Move *m = &board_moves[i];
+        Shogi shogi = corpus[m->position];
+        sink ^= shogi_move_piece(&shogi, m->move.from_x, m->move.from_y, m->move.to_x, m->move.to_y);
+    }
+    return board_move_count;
+}
+
+size_t run_drop_piece(void) {
+    for (size_t i = 0; i < drop_move_count; ++i) {
+        Corpus_Move *m = &drop_moves[i];
+        Shogi shogi = corpus[m->position];
+        sink ^= shogi_drop_piece(&shogi, shogi.turn, m->move.drop_kind, m->move.to_x, m->move.to_y);
+    }
+    return drop_move_count;
+}
+
+size_t run_apply_move(void) {
+    for (size_t i = 0; i < board_move_count; ++i) {
+        Corpus_Move *m = &board_moves[i];
+        Shogi shogi = corpus[m->position];
+        shogi_apply_move(&shogi, m->move);
+        sink ^= shogi.turn;
+    }
+    for (size_t i = 0; i < drop_move_count; ++i) {
+        Corpus_Move *m = &drop_moves[i];
+        Shogi shogi = corpus[m->position];
+        shogi_apply_move(&shogi, m->move);
+        sink ^= shogi.turn;
+    }
+    return board_move_count + drop_move_count;
+}
+
+size_t run_batch_material(void) {
+    int32_t material[CORPUS_SIZE];
+    Shogi_Batch_Results results = { .material = material };
+    shogi_batch_analyze(&corpus_batch, &results, 1);
+    for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+        sink ^= material[i];
+    }
+    return CORPUS_SIZE;
+}
+
+size_t run_batch_analyze(void) {
+    uint16_t legal_move_counts[CORPUS_SIZE];
+    bool in_check[CORPUS_SIZE];
+    int32_t material[CORPUS_SIZE];
+    bool mate_in_one[CORPUS_SIZE];
+    Shogi_Batch_Results results = { legal_move_counts, in_check, material, mate_in_one };
+    shogi_batch_analyze(&corpus_batch, &results, 1);
+    for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+        sink ^= legal_move_counts[i] + in_check[i] + material[i] + mate_in_one[i];
+    }
+    return CORPUS_SIZE;
+}
+
+static const Kernel kernels[] = {
+    { "king_moves_at", run_king_moves_at },
+    { "rook_moves_at", run_rook_moves_at },
+    { "bishop_moves_at", run_bishop_moves_at },
+    { "gold_moves_at", run_gold_moves_at },
+    { "silver_moves_at", run_silver_moves_at },
+    { "knight_moves_at", run_knight_moves_at },
+    { "lance_moves_at", run_lance_moves_at },
+    { "pawn_moves_at", run_pawn_moves_at },
+    { "piece_moves_at", run_piece_moves_at },
+    { "drop_piece_locations", run_drop_piece_locations },
+    { "color_moves", run_color_moves },
+    { "find_king", run_find_king },
+    { "legal_moves", run_legal_moves },
+    { "sfen_load", run_sfen_load },
+    { "move_piece", run_move_piece },
+    { "drop_piece", run_drop_piece },
+    { "apply_move", run_apply_move },
+    { "batch_material", run_batch_material },
+    { "batch_analyze", run_batch_analyze },
+};
+
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+void corpus_init(void) {
+    if (!shogi_batch_alloc(&corpus_batch, CORPUS_SIZE)) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+        if (shogi_load_from_sfen(&corpus[i], corpus_sfens[i]) < 0) {
+            fprintf(stderr, "Error: incorrect sfen in corpus: %s\n", corpus_sfens[i]);
+            exit(1);
+        }
+
+        Shogi *shogi = &corpus[i];
+        shogi_batch_store(&corpus_batch, i, shogi);
+        for (int32_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
+            for (int32_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
+                Shogi_Cell cell = shogi->board[y][x];
+                if (cell.contains_piece) {
+                    Shogi_Kind kind = cell.piece.kind;
+                    assert(target_counts[kind] < MAX_TARGETS);
+                    targets[kind][target_counts[kind]++] = (Target) {
+                        i, x, y, cell.piece.color, cell.piece.is_promoted
+                    };
+                }
+            }
+        }
+
+        Shogi_Move moves[SHOGI_MAX_MOVES];
+        size_t move_count = shogi_legal_moves(shogi, moves, SHOGI_MAX_MOVES);
+        for (size_t j = 0; j < move_count; ++j) {
+            Corpus_Move m = { i, moves[j] };
+            if (moves[j].is_drop) {
+                assert(drop_move_count < sizeof(drop_moves) / sizeof(drop_moves[0]));
+                drop_moves[drop_move_count++] = m;
+            } else if (!moves[j].promote) {
+                assert(board_move_count < sizeof(board_moves) / sizeof(board_moves[0]));
+                board_moves[board_move_count++] = m;
+            }
+        }
+    }
+}
+
+int compare_double(const void *a, const void *b) {
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+    return (da > db) - (da < db);
+}
+
+typedef struct {
+    double mean;
+    double median;
+    double stddev;
+    double min;
+} Result;
+
+Result measure(const Kernel *kernel) {
+    // Calibrate the number of passes per sample, warming the caches on the way
+    size_t passes = 1;
+    for (;;) {
+        double start = shogi_now_seconds();
+        for (size_t i = 0; i < passes; ++i) {
+            kernel->run();
+        }
+        if (shogi_now_seconds() - start >= config.sample_seconds || passes >= (1u << 30)) {
+            break;
+        }
+        passes *= 2;
+    }
+
+    double *ns = malloc(sizeof(double) * config.samples);
+    if (ns == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    for (size_t s = 0; s < config.samples; ++s) {
+        size_t ops = 0;
+        double start = shogi_now_seconds();
+        for (size_t i = 0; i < passes; ++i) {
+            ops += kernel->run();
+        }
+        double elapsed = shogi_now_seconds() - start;
+        ns[s] = (ops > 0) ? elapsed * 1e9 / ops : 0.0;
+    }
+
+    Result result = {0};
+    for (size_t s = 0; s < config.samples; ++s) {
+        result.mean += ns[s];
+    }
+    result.mean /= config.samples;
+    for (size_t s = 0; s < config.samples; ++s) {
+        result.stddev += (ns[s] - result.mean) * (ns[s] - result.mean);
+    }
+    result.stddev = sqrt(result.stddev / config.samples);
+    qsort(ns, config.samples, sizeof(double), compare_double);
+    result.min = ns[0];
+    result.median = (config.samples % 2 == 1)
+        ? ns[config.samples / 2]
+        : (ns[config.samples / 2 - 1] + ns[config.samples / 2]) / 2;
+    free(ns);
+    return result;
+}
+
+// Reads back a file written by this program, one kernel per line
+size_t baseline_load(const char *path, Baseline_Entry *entries, size_t capacity) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Error: could not open baseline %s\n", path);
+        exit(1);
+    }
+    size_t count = 0;
+    char line[512];
+    while (count < capacity && fgets(line, sizeof(line), f) != NULL) {
+        const char *name = strstr(line, "\"name\": \"");
+        const char *median = strstr(line, "\"median\": ");
+        if (name == NULL || median == NULL) {
+            continue;
+        }
+        Baseline_Entry *entry = &entries[count];
+        if (sscanf(name, "\"name\": \"%63[^\"]\"", entry->name) == 1 &&
+            sscanf(median, "\"median\": %lf", &entry->median) == 1)
+        {
+            count += 1;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "    -n <samples>       samples per kernel (default %zu)\n", config.samples);
+    fprintf(stderr, "    -m <ms>            minimum time per sample (default %.0f)\n", config.sample_seconds * 1000);
+    fprintf(stderr, "    -k <substring>     only run kernels whose name contains it\n");
+    fprintf(stderr, "    -o <path>          write results as JSON\n");
+    fprintf(stderr, "    -b <path>          compare against a baseline JSON file\n");
+    fprintf(stderr, "    -t <percent>       allowed slowdown against the baseline (default %.0f)\n", config.threshold);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        const char *flag = argv[i];
+        if (i + 1 >= argc || strlen(flag) != 2 || flag[0] != '-') {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        switch (flag[1]) {
+        case 'n': config.samples = strtoull(value, NULL, 10); break;
+        case 'm': config.sample_seconds = atof(value) / 1000; break;
+        case 'k': config.filter = value; break;
+        case 'o': config.output_path = value; break;
+        case 'b': config.baseline_path = value; break;
+        case 't': config.threshold = atof(value); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.samples == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Baseline_Entry baseline[MAX_BASELINE];
+    size_t baseline_count = 0;
+    if (config.baseline_path != NULL) {
+        baseline_count = baseline_load(config.baseline_path, baseline, MAX_BASELINE);
+    }
+
+    FILE *output = NULL;
+    if (config.output_path != NULL) {
+        output = fopen(config.output_path, "w");
+        if (output == NULL) {
+            fprintf(stderr, "Error: could not open %s\n", config.output_path);
+            return 1;
+        }
+        fprintf(output, "{\n  \"corpus\": %zu,\n  \"samples\": %zu,\n  \"kernels\": [\n",
+            CORPUS_SIZE, config.samples);
+    }
+
+    corpus_init();
+
+    printf("%-22s %12s %12s %10s %12s %10s\n", "kernel", "mean ns/op", "median", "stddev", "min", "baseline");
+    size_t regressions = 0;
+    bool first = true;
+    for (size_t k = 0; k < KERNEL_COUNT; ++k) {
+        const Kernel *kernel = &kernels[k];
+        if (config.filter != NULL && strstr(kernel->name, config.filter) == NULL) {
+            continue;
+        }
+        Result result = measure(kernel);
+
+        char verdict[32] = "";
+        for (size_t b = 0; b < baseline_count; ++b) {
+            if (strcmp(baseline[b].name, kernel->name) == 0 && baseline[b].median > 0) {
+                double change = (result.median / baseline[b].median - 1) * 100;
+                bool regressed = change > config.threshold;
+                snprintf(verdict, sizeof(verdict), "%+.1f%%%s", change, regressed ? " SLOWER" : "");
+                regressions += regressed;
+            }
+        }
+        printf("%-22s %12.1f %12.1f %10.1f %12.1f %10s\n",
+            kernel->name, result.mean, result.median, result.stddev, result.min, verdict);
+
+        if (output != NULL) {
+            fprintf(output, "%s    {\"name\": \"%s\", \"mean\": %.3f, \"median\": %.3f, \"stddev\": %.3f, \"min\": %.3f}",
+                first ? "" : ",\n", kernel->name, result.mean, result.median, result.stddev, result.min);
+            first = false;
+        }
+    }
+
+    if (output != NULL) {
+        fprintf(output, "\n  ]\n}\n");
+        fclose(output);
+    }
+
+    if (regressions > 0) {
+        printf("%zu kernel(s) slower than the baseline by more than %.1f%%\n", regressions, config.threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,385 @@
+#define _POSIX_C_SOURCE 200809L
+#define SHOGI_IMPLEMENTATION
+#include "./shogi.h"
+#define SHOGI_BOOK_IMPLEMENTATION
+#include "./shogi_book.h"
+
+// Opening book builder and prober.
+//
+// The builder reads one game per line in USI position syntax:
+//     [position] startpos moves 7g7f 3c3d ... [result b|w|d]
+//     [position] sfen <sfen> moves 7g7f 3c3d ... [result b|w|d]
+// The optional trailing result names the winner (black, white) or a draw.
+// Without it the result is taken from the final position: if the side to
+// move has no legal moves it lost, otherwise the game counts as a draw.
+// Book entries are collected into a bounded buffer which is sorted,
+// aggregated and spilled to a temporary run file whenever it fills up;
+// the runs are merged into the final book at the end.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    size_t memory;
+    size_t max_ply;
+} Config;
+
+typedef struct {
+    Shogi_Book_Entry *items;
+    size_t count;
+    size_t capacity;
+
+    FILE **runs;
+    size_t run_count;
+
+    // Scratch space for the entries of the game being parsed, max_ply long
+    Shogi_Book_Entry *game_entries;
+    Shogi_Color *game_movers;
+
+    size_t games;
+    size_t skipped;
+} Builder;
+
+static Config config = {
+    .memory = 256,
+    .max_ply = 40,
+};
+
+bool move_is_legal(Shogi *shogi, Shogi_Move move) {
+    Shogi_Move moves[SHOGI_MAX_MOVES];
+    size_t move_count = shogi_legal_moves(shogi, moves, SHOGI_MAX_MOVES);
+    for (size_t i = 0; i < move_count; ++i) {
+        if (shogi_book_move_encode(moves[i]) == shogi_book_move_encode(move)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void builder_spill(Builder *builder) {
+    if (builder->count == 0) {
+        return;
+    }
+    qsort(builder->items, builder->count, sizeof(Shogi_Book_Entry), shogi_book_entry_compare);
+
+    size_t count = 0;
+    for (size_t i = 0; i < builder->count; ++i) {
+        Shogi_Book_Entry *item = &builder->items[i];
+        Shogi_Book_Entry *last = (count > 0) ? &builder->items[count - 1] : NULL;
+        if (last != NULL && shogi_book_entry_compare(last, item) == 0) {
+            last->weight = (last->weight + item->weight > UINT16_MAX) ? UINT16_MAX : last->weight + item->weight;
+            last->wins += item->wins;
+            last->draws += item->draws;
+            last->losses += item->losses;
+        } else {
+            builder->items[count++] = *item;
+        }
+    }
+
+    FILE *run = tmpfile();
+    if (run == NULL || fwrite(builder->items, sizeof(Shogi_Book_Entry), count, run) != count) {
+        fprintf(stderr, "Error: could not write temporary run\n");
+        exit(1);
+    }
+    builder->runs = realloc(builder->runs, sizeof(FILE *) * (builder->run_count + 1));
+    if (builder->runs == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    builder->runs[builder->run_count++] = run;
+    builder->count = 0;
+}
+
+void builder_push(Builder *builder, Shogi_Book_Entry entry) {
+    if (builder->count == builder->capacity) {
+        builder_spill(builder);
+    }
+    builder->items[builder->count++] = entry;
+}
+
+void builder_add_game(Builder *builder, Shogi_String_View line) {
+    Shogi_String_View token = shogi_sv_next_token(&line);
+    if (shogi_sv_eq(token, "position")) {
+        token = shogi_sv_next_token(&line);
+    }
+    if (token.size == 0) {
+        return;
+    }
+
+    char sfen[SHOGI_SFEN_CAPACITY] = SHOGI_START_SFEN;
+    if (shogi_sv_eq(token, "sfen")) {
+        size_t size = 0;
+        for (token = shogi_sv_next_token(&line); token.size > 0 && !shogi_sv_eq(token, "moves"); token = shogi_sv_next_token(&line)) {
+            if (size + token.size + 1 >= SHOGI_SFEN_CAPACITY) {
+                builder->skipped += 1;
+                return;
+            }
+            if (size > 0) sfen[size++] = ' ';
+            memcpy(&sfen[size], token.data, token.size);
+            size += token.size;
+        }
+        sfen[size] = '\0';
+    } else if (shogi_sv_eq(token, "startpos")) {
+        token = shogi_sv_next_token(&line);
+    } else {
+        builder->skipped += 1;
+        return;
+    }
+    if (token.size > 0 && !shogi_sv_eq(token, "moves")) {
+        builder->skipped += 1;
+        return;
+    }
+
+    Shogi shogi = {0};
+    if (shogi_load_from_sfen(&shogi, sfen) < 0) {
+        builder->skipped += 1;
+        return;
+    }
+
+    Shogi_Book_Entry *entries = builder->game_entries;
+    Shogi_Color *movers = builder->game_movers;
+    size_t entry_count = 0;
+    for (token = shogi_sv_next_token(&line); token.size > 0 && !shogi_sv_eq(token, "result"); token = shogi_sv_next_token(&line)) {
+        Shogi_Move move;
+        // Moves past max_ply add no entries, but the final position decides
+        // the result, so every move has to be legal
+        if (!shogi_move_from_usi(token, &move) || !move_is_legal(&shogi, move)) {
+            builder->skipped += 1;
+            return;
+        }
+        if (entry_count < config.max_ply) {
+            entries[entry_count] = (Shogi_Book_Entry) {
+                .key = shogi_hash(&shogi),
+                .move = shogi_book_move_encode(move),
+                .weight = 1,
+            };
+            movers[entry_count] = shogi.turn;
+            entry_count += 1;
+        }
+        shogi_apply_move(&shogi, move);
+    }
+
+    // winner is SHOGI_COLOR_COUNT for a draw
+    Shogi_Color winner = SHOGI_COLOR_COUNT;
+    if (token.size > 0) {
+        token = shogi_sv_next_token(&line);
+        if (shogi_sv_eq(token, "b")) {
+            winner = SHOGI_BLACK;
+        } else if (shogi_sv_eq(token, "w")) {
+            winner = SHOGI_WHITE;
+        } else if (!shogi_sv_eq(token, "d")) {
+            builder->skipped += 1;
+            return;
+        }
+        if (shogi_sv_next_token(&line).size > 0) {
+            builder->skipped += 1;
+            return;
+        }
+    } else {
+        Shogi_Move moves[SHOGI_MAX_MOVES];
+        if (shogi_legal_moves(&shogi, moves, SHOGI_MAX_MOVES) == 0) {
+            winner = !shogi.turn;
+        }
+    }
+
+    for (size_t i = 0; i < entry_count; ++i) {
+        if (winner == SHOGI_COLOR_COUNT) {
+            entries[i].draws = 1;
+        } else if (movers[i] == winner) {
+            entries[i].wins = 1;
+        } else {
+            entries[i].losses = 1;
+        }
+        builder_push(builder, entries[i]);
+    }
+    builder->games += 1;
+}
+
+bool run_read(FILE *run, Shogi_Book_Entry *entry) {
+    return fread(entry, sizeof(Shogi_Book_Entry), 1, run) == 1;
+}
+
+// Runs are few (input size / memory budget), so picking the smallest head
+// with a linear scan is cheap next to the I/O
+size_t builder_merge(Builder *builder, FILE *output) {
+    size_t run_count = builder->run_count;
+    Shogi_Book_Entry *heads = malloc(sizeof(Shogi_Book_Entry) * run_count);
+    bool *alive = malloc(sizeof(bool) * run_count);
+    if ((heads == NULL || alive == NULL) && run_count > 0) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < run_count; ++i) {
+        rewind(builder->runs[i]);
+        alive[i] = run_read(builder->runs[i], &heads[i]);
+    }
+
+    size_t count = 0;
+    bool has_current = false;
+    Shogi_Book_Entry current = {0};
+    for (;;) {
+        size_t min = run_count;
+        for (size_t i = 0; i < run_count; ++i) {
+            if (alive[i] && (min == run_count || shogi_book_entry_compare(&heads[i], &heads[min]) < 0)) {
+                min = i;
+            }
+        }
+        if (min == run_count) {
+            break;
+        }
+
+        Shogi_Book_Entry *head = &heads[min];
+        if (has_current && shogi_book_entry_compare(&current, head) == 0) {
+            current.weight = (current.weight + head->weight > UINT16_MAX) ? UINT16_MAX : current.weight + head->weight;
+            current.wins += head->wins;
+            current.draws += head->draws;
+            current.losses += head->losses;
+        } else {
+            if (has_current) {
+                fwrite(&current, sizeof(Shogi_Book_Entry), 1, output);
+                count += 1;
+            }
+            current = *head;
+            has_current = true;
+        }
+        alive[min] = run_read(builder->runs[min], &heads[min]);
+    }
+    if (has_current) {
+        fwrite(&current, sizeof(Shogi_Book_Entry), 1, output);
+        count += 1;
+    }
+
+    for (size_t i = 0; i < run_count; ++i) {
+        fclose(builder->runs[i]);
+    }
+    free(alive);
+    free(heads);
+    return count;
+}
+
+int build(const char *input_path, const char *output_path) {
+    FILE *input = fopen(input_path, "r");
+    if (input == NULL) {
+        fprintf(stderr, "Error: could not open %s\n", input_path);
+        return 1;
+    }
+    FILE *output = fopen(output_path, "wb");
+    if (output == NULL) {
+        fprintf(stderr, "Error: could not open %s\n", output_path);
+        return 1;
+    }
+
+    Builder builder = {0};
+    builder.capacity = config.memory * 1024 * 1024 / sizeof(Shogi_Book_Entry);
+    builder.items = malloc(sizeof(Shogi_Book_Entry) * builder.capacity);
+    builder.game_entries = malloc(sizeof(Shogi_Book_Entry) * config.max_ply);
+    builder.game_movers = malloc(sizeof(Shogi_Color) * config.max_ply);
+    if (builder.capacity == 0 || builder.items == NULL || builder.game_entries == NULL || builder.game_movers == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+
+    double start = shogi_now_seconds();
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_size;
+    while ((line_size = getline(&line, &line_capacity, input)) >= 0) {
+        builder_add_game(&builder, (Shogi_String_View) { line, line_size });
+    }
+    free(line);
+    fclose(input);
+    builder_spill(&builder);
+    free(builder.game_movers);
+    free(builder.game_entries);
+    free(builder.items);
+
+    Shogi_Book_Header header = { SHOGI_BOOK_MAGIC, 0 };
+    fwrite(&header, sizeof(header), 1, output);
+    header.count = builder_merge(&builder, output);
+    fseek(output, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, output);
+    if (ferror(output) || fclose(output) != 0) {
+        fprintf(stderr, "Error: could not write %s\n", output_path);
+        return 1;
+    }
+    free(builder.runs);
+
+    printf("%zu games (%zu skipped), %zu runs, %llu entries in %.2fs -> %s\n",
+        builder.games, builder.skipped, builder.run_count,
+        (unsigned long long) header.count, shogi_now_seconds() - start, output_path);
+    return 0;
+}
+
+int probe(const char *book_path, const char *sfen) {
+    Shogi_Book book = {0};
+    if (!shogi_book_open(&book, book_path)) {
+        fprintf(stderr, "Error: could not open book %s\n", book_path);
+        return 1;
+    }
+    Shogi shogi = {0};
+    if (shogi_load_from_sfen(&shogi, sfen) < 0) {
+        fprintf(stderr, "Error: incorrect sfen\n");
+        return 1;
+    }
+
+    uint64_t key = shogi_hash(&shogi);
+    const Shogi_Book_Entry *entries;
+    double start = shogi_now_seconds();
+    size_t count = shogi_book_probe(&book, key, &entries);
+    double elapsed = shogi_now_seconds() - start;
+
+    for (size_t i = 0; i < count; ++i) {
+        char usi[6];
+        shogi_move_to_usi(shogi_book_move_decode(entries[i].move), usi);
+        printf("%-6s weight %5u  +%u =%u -%u\n", usi, entries[i].weight,
+            entries[i].wins, entries[i].draws, entries[i].losses);
+    }
+    printf("%zu moves out of %zu entries, probe took %.0fns\n", count, book.count, elapsed * 1e9);
+    shogi_book_close(&book);
+    return 0;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s build [-m <memory MB>] [-p <max ply>] <games.txt> <book.bin>\n", program);
+    fprintf(stderr, "       %s probe <book.bin> [sfen]\n", program);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "build") == 0) {
+        int i = 2;
+        for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+            if (strcmp(argv[i], "-m") == 0) {
+                config.memory = strtoull(argv[i + 1], NULL, 10);
+            } else if (strcmp(argv[i], "-p") == 0) {
+                config.max_ply = strtoull(argv[i + 1], NULL, 10);
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if (i + 2 != argc || config.memory == 0 || config.max_ply == 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        return build(argv[i], argv[i + 1]);
+    }
+
+    if (strcmp(argv[1], "probe") == 0) {
+        if (argc > 4) {
+            usage(argv[0]);
+            return 1;
+        }
+        return probe(argv[2], (argc == 4) ? argv[3] : SHOGI_START_SFEN);
+    }
+
+    usage(argv[0]);
+    return 1;
+}
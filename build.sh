@@ -5,3 +5,14 @@ CFLAGS="-Wall -Wextra -pedantic -std=c11 -ggdb `pkg-config --cflags raylib`"
 CLIBS="`pkg-config --libs raylib`"
 
 gcc $CFLAGS -o shogi main.c $CLIBS
+
+# -O2 alone uses the "very cheap" vectorizer cost model, which skips the
+# widening loads in the shogi_batch.h material sweeps
+TOOL_CFLAGS="-Wall -Wextra -pedantic -std=c11 -ggdb -O2 -fvect-cost-model=dynamic"
+TOOL_CLIBS="-lpthread"
+
+gcc $TOOL_CFLAGS -o datagen datagen.c $TOOL_CLIBS
+gcc $TOOL_CFLAGS -o book book.c $TOOL_CLIBS
+gcc $TOOL_CFLAGS -DSHOGI_PROFILE -o datagen-profile datagen.c $TOOL_CLIBS
+gcc $TOOL_CFLAGS -o bench bench.c $TOOL_CLIBS -lm
+gcc $TOOL_CFLAGS -o server server.c $TOOL_CLIBS
@@ -0,0 +1,446 @@
+#define _POSIX_C_SOURCE 200809L
+#define SHOGI_IMPLEMENTATION
+#include "./shogi.h"
+
+// Self-play training data generator.
+// Every worker plays games from a randomized opening, searching each position
+// at a fixed shallow depth, and records (position, score, result) tuples.
+// Records are accumulated in per-thread buffers and appended to the output
+// file in large batches, so the only shared state on the hot path is an
+// atomic position counter.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Layout of a record (little endian):
+//   [0..80]  board cells, shogi_cell_encode, row major from the top left
+//   [81..94] hand counts, black then white, SHOGI_ROOK..SHOGI_PAWN
+//   [95]     side to move
+//   [96..97] search score in centipawns from the side to move's perspective
+//   [98]     game result from the side to move's perspective (1, 0, -1)
+//   [99]     ply clamped to 255
+#define RECORD_SIZE 100
+#define RECORD_HANDS (SHOGI_BOARD_DIM * SHOGI_BOARD_DIM)
+#define RECORD_TURN (RECORD_HANDS + SHOGI_COLOR_COUNT * (SHOGI_KIND_COUNT - 1))
+#define RECORD_SCORE (RECORD_TURN + 1)
+#define RECORD_RESULT (RECORD_SCORE + 2)
+#define RECORD_PLY (RECORD_RESULT + 1)
+
+#define THREAD_BUFFER_RECORDS (64 * 1024)
+#define MAX_GAME_PLIES 256
+#define TT_BITS 16
+
+#define MATE_SCORE 30000
+#define INF_SCORE 32000
+
+typedef struct {
+    uint64_t key;
+    int16_t score;
+    int8_t depth;
+    uint8_t bound;
+} TT_Entry;
+
+enum {
+    BOUND_EXACT,
+    BOUND_LOWER,
+    BOUND_UPPER,
+};
+
+typedef struct {
+    size_t threads;
+    size_t positions;
+    int32_t depth;
+    size_t random_plies;
+    uint64_t seed;
+    const char *output_path;
+    const char *trace_path;
+} Config;
+
+typedef struct {
+    uint64_t rng;
+    TT_Entry *tt;
+
+    uint8_t *buffer;
+    size_t buffer_count;
+    uint8_t game[MAX_GAME_PLIES][RECORD_SIZE];
+} Worker;
+
+static Config config = {
+    .threads = 1,
+    .positions = 1000,
+    .depth = 2,
+    .random_plies = 8,
+    .seed = 1,
+    .output_path = "datagen.bin",
+    .trace_path = NULL,
+};
+
+static FILE *output = NULL;
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_size_t positions_done = 0;
+static atomic_size_t games_done = 0;
+static atomic_size_t workers_running = 0;
+
+#ifdef SHOGI_PROFILE
+static FILE *trace = NULL;
+static bool trace_first = true;
+static uint64_t counter_totals[SHOGI_COUNTER_COUNT] = {0};
+static pthread_mutex_t profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif // SHOGI_PROFILE
+
+uint64_t rng_next(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+int32_t evaluate(Shogi *shogi) {
+    int32_t score = 0;
+    for (size_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
+        for (size_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
+            Shogi_Cell cell = shogi->board[y][x];
+            if (cell.contains_piece) {
+                Shogi_Piece piece = cell.piece;
+                int32_t value = shogi_piece_value(piece);
+                score += (piece.color == shogi->turn) ? value : -value;
+            }
+        }
+    }
+    for (size_t kind = 0; kind < SHOGI_KIND_COUNT; ++kind) {
+        score += shogi->hands[shogi->turn][kind] * shogi_piece_values[kind];
+        score -= shogi->hands[!shogi->turn][kind] * shogi_piece_values[kind];
+    }
+    return score;
+}
+
+int32_t search(Worker *worker, Shogi *shogi, int32_t depth, int32_t ply, int32_t alpha, int32_t beta) {
+    SHOGI_COUNT(SHOGI_COUNTER_SEARCH_NODES);
+    if (depth <= 0) {
+        return evaluate(shogi);
+    }
+
+    uint64_t key = shogi_hash(shogi);
+    TT_Entry *entry = &worker->tt[key & ((1 << TT_BITS) - 1)];
+    if (entry->key == key && entry->depth >= depth) {
+        SHOGI_COUNT(SHOGI_COUNTER_HASH_HITS);
+        if (entry->bound == BOUND_EXACT) return entry->score;
+        if (entry->bound == BOUND_LOWER && entry->score >= beta) return entry->score;
+        if (entry->bound == BOUND_UPPER && entry->score <= alpha) return entry->score;
+    }
+
+    Shogi_Move moves[SHOGI_MAX_MOVES];
+    size_t move_count = shogi_legal_moves(shogi, moves, SHOGI_MAX_MOVES);
+    if (move_count == 0) {
+        return -MATE_SCORE + ply;
+    }
+
+    int32_t original_alpha = alpha;
+    int32_t best = -INF_SCORE;
+    for (size_t i = 0; i < move_count; ++i) {
+        Shogi child = *shogi;
+        shogi_apply_move(&child, moves[i]);
+        int32_t score = -search(worker, &child, depth - 1, ply + 1, -beta, -alpha);
+        if (score > best) best = score;
+        if (score > alpha) alpha = score;
+        if (alpha >= beta) break;
+    }
+
+    entry->key = key;
+    entry->score = best;
+    entry->depth = depth;
+    entry->bound = (best <= original_alpha) ? BOUND_UPPER : (best >= beta) ? BOUND_LOWER : BOUND_EXACT;
+    return best;
+}
+
+// Picks the best root move, breaking ties at random so games don't repeat
+bool search_root(Worker *worker, Shogi *shogi, Shogi_Move *best_move, int32_t *best_score) {
+    Shogi_Move moves[SHOGI_MAX_MOVES];
+    size_t move_count = shogi_legal_moves(shogi, moves, SHOGI_MAX_MOVES);
+    if (move_count == 0) {
+        return false;
+    }
+
+    size_t ties = 0;
+    int32_t best = -INF_SCORE;
+    for (size_t i = 0; i < move_count; ++i) {
+        Shogi child = *shogi;
+        shogi_apply_move(&child, moves[i]);
+        int32_t score = -search(worker, &child, config.depth - 1, 1, -INF_SCORE, -best + 1);
+        if (score > best) {
+            best = score;
+            *best_move = moves[i];
+            ties = 1;
+        } else if (score == best) {
+            ties += 1;
+            if (rng_next(&worker->rng) % ties == 0) {
+                *best_move = moves[i];
+            }
+        }
+    }
+    *best_score = best;
+    return true;
+}
+
+void record_encode(Shogi *shogi, int32_t score, size_t ply, uint8_t *record) {
+    for (size_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
+        for (size_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
+            record[y * SHOGI_BOARD_DIM + x] = shogi_cell_encode(shogi->board[y][x]);
+        }
+    }
+    uint8_t *hands = &record[RECORD_HANDS];
+    for (size_t color = 0; color < SHOGI_COLOR_COUNT; ++color) {
+        for (size_t kind = SHOGI_ROOK; kind < SHOGI_KIND_COUNT; ++kind) {
+            *hands++ = shogi->hands[color][kind];
+        }
+    }
+    uint16_t clamped = (uint16_t) (int16_t) score;
+    record[RECORD_TURN] = shogi->turn;
+    record[RECORD_SCORE + 0] = clamped & 0xFF;
+    record[RECORD_SCORE + 1] = clamped >> 8;
+    record[RECORD_RESULT] = 0;
+    record[RECORD_PLY] = (ply > 255) ? 255 : ply;
+}
+
+void worker_flush(Worker *worker) {
+    if (worker->buffer_count == 0) {
+        return;
+    }
+    SHOGI_TRACE_BEGIN(start);
+    pthread_mutex_lock(&output_mutex);
+    size_t written = fwrite(worker->buffer, RECORD_SIZE, worker->buffer_count, output);
+    pthread_mutex_unlock(&output_mutex);
+    SHOGI_TRACE_END(start, "flush");
+    if (written != worker->buffer_count) {
+        fprintf(stderr, "Error: could not write to %s\n", config.output_path);
+        exit(1);
+    }
+    worker->buffer_count = 0;
+}
+
+// Claims up to `wanted` of the remaining positions so that concurrent games
+// never push the output past config.positions
+size_t reserve_positions(size_t wanted) {
+    size_t done = atomic_load(&positions_done);
+    size_t take;
+    do {
+        if (done >= config.positions) {
+            return 0;
+        }
+        take = config.positions - done;
+        if (take > wanted) {
+            take = wanted;
+        }
+    } while (!atomic_compare_exchange_weak(&positions_done, &done, done + take));
+    return take;
+}
+
+void worker_play_game(Worker *worker) {
+    SHOGI_TRACE_BEGIN(game_start);
+    Shogi shogi = {0};
+    if (shogi_load_from_sfen(&shogi, SHOGI_START_SFEN) < 0) {
+        fprintf(stderr, "Error: incorrect sfen\n");
+        exit(1);
+    }
+
+    Shogi_Move moves[SHOGI_MAX_MOVES];
+    for (size_t i = 0; i < config.random_plies; ++i) {
+        size_t move_count = shogi_legal_moves(&shogi, moves, SHOGI_MAX_MOVES);
+        if (move_count == 0) {
+            return;
+        }
+        shogi_apply_move(&shogi, moves[rng_next(&worker->rng) % move_count]);
+    }
+
+    memset(worker->tt, 0, sizeof(TT_Entry) * (1 << TT_BITS));
+
+    size_t ply = 0;
+    Shogi_Color loser = SHOGI_COLOR_COUNT;
+    for (; ply < MAX_GAME_PLIES; ++ply) {
+        Shogi_Move move;
+        int32_t score;
+        SHOGI_TRACE_BEGIN(search_start);
+        bool has_move = search_root(worker, &shogi, &move, &score);
+        SHOGI_TRACE_END(search_start, "search_root");
+        if (!has_move) {
+            loser = shogi.turn;
+            break;
+        }
+        record_encode(&shogi, score, config.random_plies + ply, worker->game[ply]);
+        shogi_apply_move(&shogi, move);
+    }
+
+    size_t take = reserve_positions(ply);
+    for (size_t i = 0; i < take; ++i) {
+        uint8_t *record = worker->game[i];
+        int8_t result = 0;
+        if (loser != SHOGI_COLOR_COUNT) {
+            result = (record[RECORD_TURN] == loser) ? -1 : 1;
+        }
+        record[RECORD_RESULT] = (uint8_t) result;
+
+        if (worker->buffer_count == THREAD_BUFFER_RECORDS) {
+            worker_flush(worker);
+        }
+        memcpy(&worker->buffer[worker->buffer_count * RECORD_SIZE], record, RECORD_SIZE);
+        worker->buffer_count += 1;
+    }
+
+    if (take > 0) {
+        atomic_fetch_add(&games_done, 1);
+    }
+    SHOGI_TRACE_END(game_start, "game");
+}
+
+void *worker_run(void *arg) {
+    Worker *worker = arg;
+    worker->tt = malloc(sizeof(TT_Entry) * (1 << TT_BITS));
+    worker->buffer = malloc((size_t) RECORD_SIZE * THREAD_BUFFER_RECORDS);
+    if (worker->tt == NULL || worker->buffer == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+
+    while (atomic_load(&positions_done) < config.positions) {
+        worker_play_game(worker);
+    }
+    worker_flush(worker);
+
+#ifdef SHOGI_PROFILE
+    pthread_mutex_lock(&profile_mutex);
+    shogi_profile_merge(counter_totals);
+    if (trace != NULL) {
+        shogi_trace_write_events(trace, &trace_first);
+    }
+    pthread_mutex_unlock(&profile_mutex);
+    shogi_profile_thread_free();
+#endif // SHOGI_PROFILE
+
+    free(worker->buffer);
+    free(worker->tt);
+    atomic_fetch_sub(&workers_running, 1);
+    return NULL;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "    -t <threads>       worker threads (default %zu)\n", config.threads);
+    fprintf(stderr, "    -n <positions>     positions to generate (default %zu)\n", config.positions);
+    fprintf(stderr, "    -d <depth>         search depth (default %d)\n", config.depth);
+    fprintf(stderr, "    -r <plies>         random opening plies (default %zu)\n", config.random_plies);
+    fprintf(stderr, "    -s <seed>          random seed (default %llu)\n", (unsigned long long) config.seed);
+    fprintf(stderr, "    -o <path>          output file (default %s)\n", config.output_path);
+#ifdef SHOGI_PROFILE
+    fprintf(stderr, "    -p <path>          write a Chrome trace-event JSON file\n");
+#endif // SHOGI_PROFILE
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        const char *flag = argv[i];
+        if (i + 1 >= argc || strlen(flag) != 2 || flag[0] != '-') {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        switch (flag[1]) {
+        case 't': config.threads = strtoull(value, NULL, 10); break;
+        case 'n': config.positions = strtoull(value, NULL, 10); break;
+        case 'd': config.depth = atoi(value); break;
+        case 'r': config.random_plies = strtoull(value, NULL, 10); break;
+        case 's': config.seed = strtoull(value, NULL, 10); break;
+        case 'o': config.output_path = value; break;
+#ifdef SHOGI_PROFILE
+        case 'p': config.trace_path = value; break;
+#endif // SHOGI_PROFILE
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.threads == 0 || config.depth < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    output = fopen(config.output_path, "wb");
+    if (output == NULL) {
+        fprintf(stderr, "Error: could not open %s\n", config.output_path);
+        return 1;
+    }
+
+#ifdef SHOGI_PROFILE
+    if (config.trace_path != NULL) {
+        trace = fopen(config.trace_path, "w");
+        if (trace == NULL) {
+            fprintf(stderr, "Error: could not open %s\n", config.trace_path);
+            return 1;
+        }
+        shogi_trace_write_begin(trace);
+    }
+#endif // SHOGI_PROFILE
+
+    Worker *workers = calloc(config.threads, sizeof(Worker));
+    pthread_t *threads = calloc(config.threads, sizeof(pthread_t));
+    if (workers == NULL || threads == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+
+    double start = shogi_now_seconds();
+    atomic_store(&workers_running, config.threads);
+    for (size_t i = 0; i < config.threads; ++i) {
+        workers[i].rng = shogi_hash_mix(config.seed * 0x10001 + i) | 1;
+        pthread_create(&threads[i], NULL, worker_run, &workers[i]);
+    }
+
+    for (size_t tick = 1; atomic_load(&workers_running) > 0; ++tick) {
+        struct timespec interval = { 0, 100 * 1000 * 1000 };
+        nanosleep(&interval, NULL);
+        if (tick % 10 != 0) {
+            continue;
+        }
+        double elapsed = shogi_now_seconds() - start;
+        size_t positions = atomic_load(&positions_done);
+        printf("%zu positions, %zu games, %.1f pos/s, %.1f pos/s/thread\n",
+            positions, atomic_load(&games_done),
+            positions / elapsed, positions / elapsed / config.threads);
+        fflush(stdout);
+    }
+
+    for (size_t i = 0; i < config.threads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    fclose(output);
+
+    double elapsed = shogi_now_seconds() - start;
+    size_t positions = atomic_load(&positions_done);
+    printf("Done: %zu positions in %.2fs, %.1f pos/s, %.1f pos/s/thread -> %s\n",
+        positions, elapsed, positions / elapsed, positions / elapsed / config.threads,
+        config.output_path);
+
+#ifdef SHOGI_PROFILE
+    for (size_t i = 0; i < SHOGI_COUNTER_COUNT; ++i) {
+        printf("    %-14s %14llu  %10.1f/position\n", shogi_counter_name(i),
+            (unsigned long long) counter_totals[i],
+            positions > 0 ? (double) counter_totals[i] / positions : 0.0);
+    }
+    if (trace != NULL) {
+        shogi_trace_write_end(trace);
+        fclose(trace);
+        printf("Trace written to %s\n", config.trace_path);
+    }
+#endif // SHOGI_PROFILE
+
+    free(threads);
+    free(workers);
+    return 0;
+}
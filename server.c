@@ -0,0 +1,759 @@
+#define _POSIX_C_SOURCE 200809L
+#define SHOGI_IMPLEMENTATION
+#include "./shogi.h"
+#define SHOGI_BATCH_IMPLEMENTATION
+#include "./shogi_batch.h"
+
+// Local multi-game analysis server.
+// Clients connect to a Unix domain socket and send one request per line;
+// every request gets exactly one response line starting with "ok" or "error".
+//
+//     new [sfen]           -> ok <id>             (starting position by default)
+//     free <id>            -> ok
+//     sfen <id>            -> ok <sfen>
+//     moves <id>           -> ok <count> <usi moves...>
+//     move <id> <usi>      -> ok <sfen>
+//     analyze <id>         -> ok moves <n> check <0|1> material <n> mate1 <0|1>
+//     stats                -> ok sessions <n> requests <n> p50_us <n> p99_us <n>
+//
+// Sessions live in a preallocated arena with a free list. All I/O is
+// multiplexed with epoll on a single thread. analyze requests are not answered
+// inline: the position is copied into a structure-of-arrays batch, and once
+// the current round of events has been handled the whole batch is analyzed
+// by the worker pool. A connection with a pending analysis stops reading
+// requests until the answer is queued, so responses stay in request order.
+// A connection whose unsent output passes OUTPUT_BACKLOG stops being read
+// until the client catches up.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define INPUT_CAPACITY 4096
+#define OUTPUT_BACKLOG (1024 * 1024)
+#define MAX_EVENTS 256
+#define MAX_BATCH 4096
+#define LATENCY_SAMPLES (64 * 1024)
+#define SESSION_INDEX_BITS 20
+
+typedef struct {
+    bool used;
+    uint32_t generation;
+    Shogi shogi;
+} Session;
+
+typedef struct {
+    int fd;
+    size_t index;
+    bool eof;
+    bool broken;
+
+    char input[INPUT_CAPACITY];
+    size_t input_size;
+    double input_time;
+    bool waiting;
+    bool held;
+
+    char *output;
+    size_t output_size;
+    size_t output_capacity;
+} Connection;
+
+typedef struct {
+    Connection *connection;
+    double start_time;
+} Job;
+
+typedef struct {
+    pthread_t *threads;
+    size_t count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint64_t generation;
+    size_t remaining;
+    bool stop;
+
+    const Shogi_Batch *batch;
+    Shogi_Batch_Results *results;
+} Pool;
+
+typedef struct {
+    const char *socket_path;
+    size_t threads;
+    size_t max_sessions;
+} Config;
+
+static Config config = {
+    .socket_path = "shogi.sock",
+    .threads = 4,
+    .max_sessions = 4096,
+};
+
+static Session *sessions = NULL;
+static uint32_t *free_sessions = NULL;
+static size_t free_session_count = 0;
+
+static Connection **connections = NULL;
+static size_t connection_count = 0;
+static size_t connection_capacity = 0;
+
+// Connections held back by a full batch, and scratch space for run_batch;
+// both have connection_capacity slots
+static Connection **held_connections = NULL;
+static size_t held_count = 0;
+static Connection **revisit_connections = NULL;
+
+static Shogi_Batch batch = {0};
+static Job jobs[MAX_BATCH];
+static size_t job_count = 0;
+
+static uint32_t latencies[LATENCY_SAMPLES];
+static size_t latency_count = 0;
+static size_t request_count = 0;
+
+static Pool pool = {0};
+static int listen_fd = -1;
+static bool accept_paused = false;
+static volatile sig_atomic_t running = 1;
+
+Shogi_String_View sv_trim(Shogi_String_View sv) {
+    while (sv.size > 0 && isspace(sv.data[0])) {
+        sv.data += 1;
+        sv.size -= 1;
+    }
+    while (sv.size > 0 && isspace(sv.data[sv.size - 1])) {
+        sv.size -= 1;
+    }
+    return sv;
+}
+
+// Latencies go into a ring of the most recent samples
+void latency_record(double start_time) {
+    double us = (shogi_now_seconds() - start_time) * 1e6;
+    latencies[latency_count % LATENCY_SAMPLES] = (us > UINT32_MAX) ? UINT32_MAX : (uint32_t) us;
+    latency_count += 1;
+}
+
+int compare_u32(const void *a, const void *b) {
+    uint32_t ua = *(const uint32_t *) a;
+    uint32_t ub = *(const uint32_t *) b;
+    return (ua > ub) - (ua < ub);
+}
+
+void latency_percentiles(uint32_t *p50, uint32_t *p99) {
+    size_t count = (latency_count < LATENCY_SAMPLES) ? latency_count : LATENCY_SAMPLES;
+    if (count == 0) {
+        *p50 = 0;
+        *p99 = 0;
+        return;
+    }
+    static uint32_t sorted[LATENCY_SAMPLES];
+    memcpy(sorted, latencies, count * sizeof(uint32_t));
+    qsort(sorted, count, sizeof(uint32_t), compare_u32);
+    *p50 = sorted[count * 50 / 100];
+    *p99 = sorted[count * 99 / 100];
+}
+
+// Ids carry the slot's generation so a stale id never reaches a reused slot
+uint32_t session_id(uint32_t index) {
+    return (sessions[index].generation << SESSION_INDEX_BITS) | index;
+}
+
+Session *session_lookup(Shogi_String_View token) {
+    char buffer[16];
+    if (token.size == 0 || token.size >= sizeof(buffer)) {
+        return NULL;
+    }
+    memcpy(buffer, token.data, token.size);
+    buffer[token.size] = '\0';
+    char *end;
+    unsigned long id = strtoul(buffer, &end, 10);
+    if (*end != '\0') {
+        return NULL;
+    }
+    size_t index = id & ((1 << SESSION_INDEX_BITS) - 1);
+    if (index >= config.max_sessions) {
+        return NULL;
+    }
+    Session *session = &sessions[index];
+    if (!session->used || session_id(index) != id) {
+        return NULL;
+    }
+    return session;
+}
+
+void connection_write(Connection *connection, const char *data, size_t size) {
+    if (connection->output_size + size > connection->output_capacity) {
+        size_t capacity = connection->output_capacity ? connection->output_capacity * 2 : 4096;
+        while (capacity < connection->output_size + size) {
+            capacity *= 2;
+        }
+        char *output = realloc(connection->output, capacity);
+        if (output == NULL) {
+            connection->broken = true;
+            return;
+        }
+        connection->output = output;
+        connection->output_capacity = capacity;
+    }
+    memcpy(&connection->output[connection->output_size], data, size);
+    connection->output_size += size;
+}
+
+void connection_printf(Connection *connection, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void connection_printf(Connection *connection, const char *fmt, ...) {
+    char buffer[1024];
+    va_list args;
+    va_start(args, fmt);
+    int size = vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+    if (size > 0) {
+        connection_write(connection, buffer, ((size_t) size < sizeof(buffer)) ? (size_t) size : sizeof(buffer) - 1);
+    }
+}
+
+void connection_flush(Connection *connection) {
+    size_t written = 0;
+    while (written < connection->output_size) {
+        ssize_t n = write(connection->fd, &connection->output[written], connection->output_size - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) connection->broken = true;
+            break;
+        }
+        written += n;
+    }
+    memmove(connection->output, &connection->output[written], connection->output_size - written);
+    connection->output_size -= written;
+}
+
+void handle_new(Connection *connection, Shogi_String_View args) {
+    Shogi shogi = {0};
+    char sfen[SHOGI_SFEN_CAPACITY] = SHOGI_START_SFEN;
+    args = sv_trim(args);
+    if (args.size > 0) {
+        if (args.size >= sizeof(sfen)) {
+            connection_printf(connection, "error sfen too long\n");
+            return;
+        }
+        memcpy(sfen, args.data, args.size);
+        sfen[args.size] = '\0';
+    }
+    // The side that just moved can't be left in check: its king would be
+    // capturable, and no move generation is defined past a captured king.
+    // Piece counts past the set's totals would wrap in the uint8_t batch hands
+    if (shogi_load_from_sfen(&shogi, sfen) < 0 ||
+        !shogi_find_king(&shogi, SHOGI_BLACK, NULL, NULL) ||
+        !shogi_find_king(&shogi, SHOGI_WHITE, NULL, NULL) ||
+        !shogi_piece_counts_valid(&shogi) ||
+        shogi_is_in_check(&shogi, !shogi.turn))
+    {
+        connection_printf(connection, "error invalid sfen\n");
+        return;
+    }
+    if (free_session_count == 0) {
+        connection_printf(connection, "error too many sessions\n");
+        return;
+    }
+    uint32_t index = free_sessions[--free_session_count];
+    Session *session = &sessions[index];
+    session->used = true;
+    session->shogi = shogi;
+    connection_printf(connection, "ok %u\n", session_id(index));
+}
+
+void handle_moves(Connection *connection, Session *session) {
+    Shogi_Move moves[SHOGI_MAX_MOVES];
+    size_t move_count = shogi_legal_moves(&session->shogi, moves, SHOGI_MAX_MOVES);
+    connection_printf(connection, "ok %zu", move_count);
+    for (size_t i = 0; i < move_count; ++i) {
+        char usi[6];
+        shogi_move_to_usi(moves[i], usi);
+        connection_printf(connection, " %s", usi);
+    }
+    connection_write(connection, "\n", 1);
+}
+
+bool move_eq(Shogi_Move a, Shogi_Move b) {
+    if (a.is_drop != b.is_drop || a.to_x != b.to_x || a.to_y != b.to_y) {
+        return false;
+    }
+    if (a.is_drop) {
+        return a.drop_kind == b.drop_kind;
+    }
+    return a.from_x == b.from_x && a.from_y == b.from_y && a.promote == b.promote;
+}
+
+void handle_move(Connection *connection, Session *session, Shogi_String_View token) {
+    Shogi_Move move;
+    if (!shogi_move_from_usi(token, &move)) {
+        connection_printf(connection, "error invalid move\n");
+        return;
+    }
+    Shogi_Move moves[SHOGI_MAX_MOVES];
+    size_t move_count = shogi_legal_moves(&session->shogi, moves, SHOGI_MAX_MOVES);
+    for (size_t i = 0; i < move_count; ++i) {
+        if (move_eq(moves[i], move)) {
+            shogi_apply_move(&session->shogi, move);
+            char sfen[SHOGI_SFEN_CAPACITY];
+            shogi_to_sfen(&session->shogi, sfen);
+            connection_printf(connection, "ok %s\n", sfen);
+            return;
+        }
+    }
+    connection_printf(connection, "error illegal move\n");
+}
+
+// Returns false when the request has to wait for the batch to be flushed
+bool handle_request(Connection *connection, Shogi_String_View line) {
+    Shogi_String_View command = shogi_sv_next_token(&line);
+    if (command.size == 0) {
+        return true;
+    }
+    request_count += 1;
+
+    if (shogi_sv_eq(command, "new")) {
+        handle_new(connection, line);
+    } else if (shogi_sv_eq(command, "stats")) {
+        uint32_t p50, p99;
+        latency_percentiles(&p50, &p99);
+        connection_printf(connection, "ok sessions %zu requests %zu p50_us %u p99_us %u\n",
+            config.max_sessions - free_session_count, request_count, p50, p99);
+    } else if (!shogi_sv_eq(command, "free") && !shogi_sv_eq(command, "sfen") && !shogi_sv_eq(command, "moves") &&
+               !shogi_sv_eq(command, "move") && !shogi_sv_eq(command, "analyze"))
+    {
+        connection_printf(connection, "error unknown command\n");
+    } else {
+        Session *session = session_lookup(shogi_sv_next_token(&line));
+        if (session == NULL) {
+            connection_printf(connection, "error unknown session\n");
+        } else if (shogi_sv_eq(command, "free")) {
+            session->used = false;
+            session->generation = (session->generation + 1) & ((1u << (32 - SESSION_INDEX_BITS)) - 1);
+            free_sessions[free_session_count++] = session - sessions;
+            connection_printf(connection, "ok\n");
+        } else if (shogi_sv_eq(command, "sfen")) {
+            char sfen[SHOGI_SFEN_CAPACITY];
+            shogi_to_sfen(&session->shogi, sfen);
+            connection_printf(connection, "ok %s\n", sfen);
+        } else if (shogi_sv_eq(command, "moves")) {
+            handle_moves(connection, session);
+        } else if (shogi_sv_eq(command, "move")) {
+            handle_move(connection, session, shogi_sv_next_token(&line));
+        } else if (shogi_sv_eq(command, "analyze")) {
+            if (job_count == MAX_BATCH) {
+                request_count -= 1;
+                if (!connection->held) {
+                    connection->held = true;
+                    held_connections[held_count++] = connection;
+                }
+                return false;
+            }
+            shogi_batch_store(&batch, job_count, &session->shogi);
+            jobs[job_count++] = (Job) { connection, connection->input_time };
+            connection->waiting = true;
+            return true;
+        }
+    }
+    latency_record(connection->input_time);
+    return true;
+}
+
+// Handles complete lines until the input runs out or a request has to wait
+void connection_process(Connection *connection) {
+    size_t consumed = 0;
+    while (!connection->waiting && !connection->broken) {
+        char *start = &connection->input[consumed];
+        char *newline = memchr(start, '\n', connection->input_size - consumed);
+        if (newline == NULL) {
+            break;
+        }
+        Shogi_String_View line = { start, newline - start };
+        if (!handle_request(connection, line)) {
+            break;
+        }
+        consumed += line.size + 1;
+    }
+    memmove(connection->input, &connection->input[consumed], connection->input_size - consumed);
+    connection->input_size -= consumed;
+    // A full buffer is only an overlong request when it holds no complete
+    // line; otherwise the lines are just held back behind a pending analysis
+    if (connection->input_size == INPUT_CAPACITY && memchr(connection->input, '\n', connection->input_size) == NULL) {
+        connection_printf(connection, "error request too long\n");
+        connection_flush(connection);
+        connection->broken = true;
+    }
+}
+
+// input_time is the arrival of the oldest unanswered request: lines still
+// buffered from an earlier read (held behind an analysis) keep their time
+void connection_read(Connection *connection) {
+    bool had_line = memchr(connection->input, '\n', connection->input_size) != NULL;
+    for (;;) {
+        if (connection->input_size == INPUT_CAPACITY) {
+            break;
+        }
+        ssize_t n = read(connection->fd, &connection->input[connection->input_size], INPUT_CAPACITY - connection->input_size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) connection->broken = true;
+            break;
+        }
+        if (n == 0) {
+            connection->eof = true;
+            break;
+        }
+        connection->input_size += n;
+    }
+    if (!had_line) {
+        connection->input_time = shogi_now_seconds();
+    }
+    connection_process(connection);
+}
+
+void accept_set_paused(int epoll_fd, bool paused) {
+    struct epoll_event event = {0};
+    event.events = paused ? 0 : EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, listen_fd, &event);
+    accept_paused = paused;
+}
+
+void connection_close(int epoll_fd, Connection *connection) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    if (accept_paused) {
+        accept_set_paused(epoll_fd, false);
+    }
+    for (size_t i = 0; i < job_count; ++i) {
+        if (jobs[i].connection == connection) {
+            jobs[i].connection = NULL;
+        }
+    }
+    if (connection->held) {
+        for (size_t i = 0; i < held_count; ++i) {
+            if (held_connections[i] == connection) {
+                held_connections[i] = held_connections[--held_count];
+                break;
+            }
+        }
+    }
+    connections[connection->index] = connections[--connection_count];
+    connections[connection->index]->index = connection->index;
+    free(connection->output);
+    free(connection);
+}
+
+// Writes what's pending and updates the epoll interest to match what's left.
+// A peer that stopped sending still gets the answers to everything it sent
+void connection_update(int epoll_fd, Connection *connection) {
+    connection_flush(connection);
+    bool done = connection->eof && !connection->waiting && connection->output_size == 0 &&
+        memchr(connection->input, '\n', connection->input_size) == NULL;
+    if (connection->broken || done) {
+        connection_close(epoll_fd, connection);
+        return;
+    }
+    struct epoll_event event = {0};
+    bool readable = !connection->eof && connection->output_size < OUTPUT_BACKLOG;
+    event.events = (readable ? EPOLLIN : 0) | ((connection->output_size > 0) ? EPOLLOUT : 0);
+    event.data.ptr = connection;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+}
+
+// Out of descriptors the listener would stay readable and spin the loop,
+// so it is taken out of epoll until a connection closes
+void accept_connections(int epoll_fd) {
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                fprintf(stderr, "Error: accept: %s, pausing new connections\n", strerror(errno));
+                accept_set_paused(epoll_fd, true);
+            }
+            return;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        Connection *connection = calloc(1, sizeof(Connection));
+        if (connection == NULL) {
+            close(fd);
+            return;
+        }
+        connection->fd = fd;
+        if (connection_count == connection_capacity) {
+            connection_capacity = connection_capacity ? connection_capacity * 2 : 64;
+            connections = realloc(connections, sizeof(Connection *) * connection_capacity);
+            held_connections = realloc(held_connections, sizeof(Connection *) * connection_capacity);
+            revisit_connections = realloc(revisit_connections, sizeof(Connection *) * connection_capacity);
+            if (connections == NULL || held_connections == NULL || revisit_connections == NULL) {
+                fprintf(stderr, "Error: out of memory\n");
+                exit(1);
+            }
+        }
+        connection->index = connection_count;
+        connections[connection_count++] = connection;
+
+        struct epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.ptr = connection;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+// Worker i analyzes the i-th contiguous chunk of every batch
+void *pool_worker(void *arg) {
+    size_t index = (size_t) arg;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&pool.mutex);
+    for (;;) {
+        while (!pool.stop && pool.generation == seen) {
+            pthread_cond_wait(&pool.start, &pool.mutex);
+        }
+        if (pool.stop) {
+            break;
+        }
+        seen = pool.generation;
+        const Shogi_Batch *pool_batch = pool.batch;
+        Shogi_Batch_Results *results = pool.results;
+        pthread_mutex_unlock(&pool.mutex);
+
+        size_t begin = pool_batch->count * index / pool.count;
+        size_t end = pool_batch->count * (index + 1) / pool.count;
+        shogi_batch_analyze_range(pool_batch, results, begin, end);
+
+        pthread_mutex_lock(&pool.mutex);
+        pool.remaining -= 1;
+        if (pool.remaining == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+    }
+    pthread_mutex_unlock(&pool.mutex);
+    return NULL;
+}
+
+void pool_start(size_t count) {
+    pool.count = count;
+    pool.threads = malloc(sizeof(pthread_t) * count);
+    if (pool.threads == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_cond_init(&pool.start, NULL);
+    pthread_cond_init(&pool.done, NULL);
+    for (size_t i = 0; i < count; ++i) {
+        if (pthread_create(&pool.threads[i], NULL, pool_worker, (void *) i) != 0) {
+            fprintf(stderr, "Error: could not start worker thread\n");
+            exit(1);
+        }
+    }
+}
+
+void pool_run(const Shogi_Batch *pool_batch, Shogi_Batch_Results *results) {
+    pthread_mutex_lock(&pool.mutex);
+    pool.batch = pool_batch;
+    pool.results = results;
+    pool.remaining = pool.count;
+    pool.generation += 1;
+    pthread_cond_broadcast(&pool.start);
+    while (pool.remaining > 0) {
+        pthread_cond_wait(&pool.done, &pool.mutex);
+    }
+    pthread_mutex_unlock(&pool.mutex);
+}
+
+void pool_stop(void) {
+    pthread_mutex_lock(&pool.mutex);
+    pool.stop = true;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.mutex);
+    for (size_t i = 0; i < pool.count; ++i) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    free(pool.threads);
+}
+
+void run_batch(int epoll_fd) {
+    static uint16_t legal_move_counts[MAX_BATCH];
+    static bool in_check[MAX_BATCH];
+    static int32_t material[MAX_BATCH];
+    static bool mate_in_one[MAX_BATCH];
+    Shogi_Batch_Results results = { legal_move_counts, in_check, material, mate_in_one };
+
+    // The batch arrays are allocated for MAX_BATCH positions, only the
+    // queued ones are analyzed
+    Shogi_Batch view = batch;
+    view.count = job_count;
+    pool_run(&view, &results);
+
+    // A connection has at most one job and is never held while it waits,
+    // so every connection ends up in the revisit list at most once
+    size_t revisit_count = 0;
+    size_t count = job_count;
+    job_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        Connection *connection = jobs[i].connection;
+        if (connection == NULL) {
+            continue;
+        }
+        connection_printf(connection, "ok moves %u check %d material %d mate1 %d\n",
+            legal_move_counts[i], in_check[i], material[i], mate_in_one[i]);
+        latency_record(jobs[i].start_time);
+        connection->waiting = false;
+        revisit_connections[revisit_count++] = connection;
+    }
+    for (size_t i = 0; i < held_count; ++i) {
+        held_connections[i]->held = false;
+        revisit_connections[revisit_count++] = held_connections[i];
+    }
+    held_count = 0;
+
+    // Only the connections that got an answer or were held back by a full
+    // batch have anything new to do; their requests may queue the next batch
+    for (size_t i = 0; i < revisit_count; ++i) {
+        Connection *connection = revisit_connections[i];
+        connection_process(connection);
+        connection_update(epoll_fd, connection);
+    }
+}
+
+void handle_signal(int signal) {
+    (void) signal;
+    running = 0;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "    -s <path>          socket path (default %s)\n", config.socket_path);
+    fprintf(stderr, "    -t <threads>       analysis worker threads (default %zu)\n", config.threads);
+    fprintf(stderr, "    -n <sessions>      maximum live sessions (default %zu)\n", config.max_sessions);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        const char *flag = argv[i];
+        if (i + 1 >= argc || strlen(flag) != 2 || flag[0] != '-') {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        switch (flag[1]) {
+        case 's': config.socket_path = value; break;
+        case 't': config.threads = strtoull(value, NULL, 10); break;
+        case 'n': config.max_sessions = strtoull(value, NULL, 10); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.threads == 0 || config.max_sessions == 0 || config.max_sessions > (1 << SESSION_INDEX_BITS)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    sessions = calloc(config.max_sessions, sizeof(Session));
+    free_sessions = malloc(config.max_sessions * sizeof(uint32_t));
+    if (sessions == NULL || free_sessions == NULL || !shogi_batch_alloc(&batch, MAX_BATCH)) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < config.max_sessions; ++i) {
+        free_sessions[free_session_count++] = config.max_sessions - 1 - i;
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(config.socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path too long\n");
+        return 1;
+    }
+    strcpy(addr.sun_path, config.socket_path);
+    unlink(config.socket_path);
+    if (listen_fd < 0 ||
+        bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, SOMAXCONN) < 0)
+    {
+        fprintf(stderr, "Error: could not listen on %s: %s\n", config.socket_path, strerror(errno));
+        return 1;
+    }
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+    int epoll_fd = epoll_create1(0);
+    struct epoll_event listen_event = {0};
+    listen_event.events = EPOLLIN;
+    listen_event.data.ptr = NULL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event);
+
+    struct sigaction action = {0};
+    action.sa_handler = handle_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pool_start(config.threads);
+    printf("Listening on %s with %zu worker threads, %zu sessions\n",
+        config.socket_path, config.threads, config.max_sessions);
+    fflush(stdout);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (running) {
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, (job_count > 0) ? 0 : -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error: epoll_wait: %s\n", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            Connection *connection = events[i].data.ptr;
+            if (connection == NULL) {
+                accept_connections(epoll_fd);
+                continue;
+            }
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !connection->eof && !connection->waiting &&
+                connection->output_size < OUTPUT_BACKLOG)
+            {
+                connection_read(connection);
+            }
+            connection_update(epoll_fd, connection);
+        }
+        if (job_count > 0) {
+            run_batch(epoll_fd);
+        }
+    }
+
+    uint32_t p50, p99;
+    latency_percentiles(&p50, &p99);
+    printf("Served %zu requests, p50 %uus, p99 %uus\n", request_count, p50, p99);
+
+    pool_stop();
+    while (connection_count > 0) {
+        connection_close(epoll_fd, connections[0]);
+    }
+    close(epoll_fd);
+    close(listen_fd);
+    unlink(config.socket_path);
+    shogi_batch_free(&batch);
+    free(revisit_connections);
+    free(held_connections);
+    free(connections);
+    free(free_sessions);
+    free(sessions);
+    return 0;
+}
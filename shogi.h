@@ -11,6 +11,8 @@
 
 #define SHOGI_BOARD_DIM 9
 
+#define SHOGI_START_SFEN "lnsgkgsnl/1r5b1/ppppppppp/9/9/9/PPPPPPPPP/1B5R1/LNSGKGSNL b -"
+
 #define SHOGI_SV(cstr) ((Shogi_String_View) { .data = (cstr), .size = strlen(cstr) })
 #define SHOGI_SV_STATIC(cstr) { .data = (cstr), .size = sizeof(cstr) - 1 }
 
@@ -61,7 +63,24 @@ typedef struct {
     bool board[SHOGI_BOARD_DIM][SHOGI_BOARD_DIM];
 } Shogi_Mask;
 
+#define SHOGI_MAX_MOVES 1024
+#define SHOGI_SFEN_CAPACITY 256
+
+typedef struct {
+    bool is_drop;
+    bool promote;
+    Shogi_Kind drop_kind;
+    int32_t from_x, from_y;
+    int32_t to_x, to_y;
+} Shogi_Move;
+
+Shogi_String_View shogi_sv_chop(Shogi_String_View *sv, char ch);
+bool shogi_sv_eq(Shogi_String_View sv, const char *cstr);
+Shogi_String_View shogi_sv_next_token(Shogi_String_View *sv);
+double shogi_now_seconds(void);
+
 Shogi shogi_from_sfen(const char *sfen_cstr);
+bool shogi_piece_counts_valid(Shogi *shogi);
 Shogi_Kind shogi_kind_from_char(char ch);
 
 bool shogi_move_piece(Shogi *shogi, size_t from_x, size_t from_y, size_t to_x, size_t to_y);
@@ -88,9 +107,93 @@ void shogi_hand_add(Shogi *shogi, Shogi_Color color, Shogi_Kind kind);
 int32_t shogi_hand_piece_count(Shogi *shogi, Shogi_Color color, Shogi_Kind kind);
 void shogi_hand_remove(Shogi *shogi, Shogi_Color color, Shogi_Kind kind);
 
+bool shogi_is_in_check(Shogi *shogi, Shogi_Color color);
+bool shogi_can_promote(Shogi_Piece piece, int32_t from_y, int32_t to_y);
+bool shogi_must_promote(Shogi_Piece piece, int32_t to_y);
+bool shogi_has_legal_move(Shogi *shogi);
+bool shogi_is_pawn_drop_mate(Shogi *shogi, int32_t x, int32_t y);
+size_t shogi_legal_moves(Shogi *shogi, Shogi_Move *moves, size_t capacity);
+void shogi_apply_move(Shogi *shogi, Shogi_Move move);
+
+uint8_t shogi_cell_encode(Shogi_Cell cell);
+Shogi_Cell shogi_cell_decode(uint8_t code);
+uint64_t shogi_hash(Shogi *shogi);
+
+// Material values shared by the evaluation and the batch kernels, indexed by kind
+extern const int32_t shogi_piece_values[SHOGI_KIND_COUNT];
+extern const int32_t shogi_promoted_values[SHOGI_KIND_COUNT];
+int32_t shogi_piece_value(Shogi_Piece piece);
+
+char shogi_char_from_kind(Shogi_Kind kind);
+size_t shogi_to_sfen(Shogi *shogi, char sfen[SHOGI_SFEN_CAPACITY]);
+bool shogi_move_from_usi(Shogi_String_View usi, Shogi_Move *move);
+void shogi_move_to_usi(Shogi_Move move, char usi[6]);
+
+// Instrumentation, compiled in only when SHOGI_PROFILE is defined.
+// Counters and trace events live in thread local storage, so every thread
+// records its own numbers and merges/writes them out when it's done.
+// Timestamps come from clock_gettime(CLOCK_MONOTONIC), so define
+// _POSIX_C_SOURCE before including shogi.h when profiling.
+// Without SHOGI_PROFILE every macro expands to nothing.
+
+typedef enum {
+    SHOGI_COUNTER_LEGAL_COPIES,
+    SHOGI_COUNTER_COLOR_MOVES,
+    SHOGI_COUNTER_WALK_STEPS,
+    SHOGI_COUNTER_MASK_ADDS,
+    SHOGI_COUNTER_SEARCH_NODES,
+    SHOGI_COUNTER_HASH_HITS,
+    SHOGI_COUNTER_COUNT,
+} Shogi_Counter;
+
+#ifdef SHOGI_PROFILE
+
+#define SHOGI_TRACE_CAPACITY (64 * 1024)
+
+typedef struct {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+} Shogi_Trace_Event;
+
+typedef struct {
+    uint64_t counters[SHOGI_COUNTER_COUNT];
+    Shogi_Trace_Event *events;
+    size_t event_count;
+    size_t dropped_events;
+    uint32_t thread_id;
+} Shogi_Profile;
+
+extern _Thread_local Shogi_Profile shogi_profile;
+
+#define SHOGI_COUNT(counter) (shogi_profile.counters[(counter)] += 1)
+#define SHOGI_TRACE_BEGIN(start) uint64_t start = shogi_profile_now_ns()
+#define SHOGI_TRACE_END(start, name) shogi_trace_record((name), (start))
+
+const char *shogi_counter_name(Shogi_Counter counter);
+uint64_t shogi_profile_now_ns(void);
+void shogi_profile_merge(uint64_t totals[SHOGI_COUNTER_COUNT]);
+void shogi_profile_reset(void);
+void shogi_profile_thread_free(void);
+void shogi_trace_record(const char *name, uint64_t start_ns);
+void shogi_trace_write_begin(FILE *stream);
+void shogi_trace_write_events(FILE *stream, bool *first);
+void shogi_trace_write_end(FILE *stream);
+
+#else
+
+#define SHOGI_COUNT(counter) ((void) 0)
+#define SHOGI_TRACE_BEGIN(start) ((void) 0)
+#define SHOGI_TRACE_END(start, name) ((void) 0)
+
+#endif // SHOGI_PROFILE
+
 #endif // SHOGI_H_
 
-#ifdef SHOGI_IMPLEMENTATION
+#if defined(SHOGI_IMPLEMENTATION) && !defined(SHOGI_IMPLEMENTATION_INCLUDED_)
+#define SHOGI_IMPLEMENTATION_INCLUDED_
+
+#include <time.h>
 
 Shogi_String_View shogi_sv_chop(Shogi_String_View *sv, char ch) {
     Shogi_String_View subsv = {0};
@@ -107,6 +210,36 @@ Shogi_String_View shogi_sv_chop(Shogi_String_View *sv, char ch) {
     return subsv;
 }
 
+bool shogi_sv_eq(Shogi_String_View sv, const char *cstr) {
+    return sv.size == strlen(cstr) && memcmp(sv.data, cstr, sv.size) == 0;
+}
+
+// Splits off the next whitespace separated token, skipping leading whitespace
+Shogi_String_View shogi_sv_next_token(Shogi_String_View *sv) {
+    while (sv->size > 0 && isspace(sv->data[0])) {
+        sv->data += 1;
+        sv->size -= 1;
+    }
+    Shogi_String_View token = { sv->data, 0 };
+    while (token.size < sv->size && !isspace(token.data[token.size])) {
+        token.size += 1;
+    }
+    sv->data += token.size;
+    sv->size -= token.size;
+    return token;
+}
+
+// Monotonic when the includer asked for POSIX, wall clock otherwise
+double shogi_now_seconds(void) {
+    struct timespec ts;
+#if defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 199309L
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 Shogi_Kind shogi_kind_from_char(char ch) {
     switch (ch) {
     case 'k': case 'K': return SHOGI_KING;
@@ -121,6 +254,35 @@ Shogi_Kind shogi_kind_from_char(char ch) {
     }
 }
 
+// Board and both hands together can't hold more of a kind than the set has
+bool shogi_piece_counts_valid(Shogi *shogi) {
+    static const int32_t totals[SHOGI_KIND_COUNT] = {
+        [SHOGI_KING] = 2,
+        [SHOGI_ROOK] = 2,
+        [SHOGI_BISHOP] = 2,
+        [SHOGI_GOLD] = 4,
+        [SHOGI_SILVER] = 4,
+        [SHOGI_KNIGHT] = 4,
+        [SHOGI_LANCE] = 4,
+        [SHOGI_PAWN] = 18,
+    };
+    int32_t counts[SHOGI_KIND_COUNT] = {0};
+    for (size_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
+        for (size_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
+            if (shogi->board[y][x].contains_piece) {
+                counts[shogi->board[y][x].piece.kind] += 1;
+            }
+        }
+    }
+    for (size_t kind = 0; kind < SHOGI_KIND_COUNT; ++kind) {
+        counts[kind] += shogi->hands[SHOGI_BLACK][kind] + shogi->hands[SHOGI_WHITE][kind];
+        if (counts[kind] > totals[kind]) {
+            return false;
+        }
+    }
+    return true;
+}
+
 int shogi_load_from_sfen(Shogi *shogi, const char *sfen_cstr) {
     Shogi_String_View sfen = SHOGI_SV(sfen_cstr);
 
@@ -149,7 +311,7 @@ int shogi_load_from_sfen(Shogi *shogi, const char *sfen_cstr) {
             }
             x = 0;
             y += 1;
-            if (y > SHOGI_BOARD_DIM) {
+            if (y >= SHOGI_BOARD_DIM) {
                 return -1;
             }
         } else if (ch == '+') {
@@ -163,7 +325,7 @@ int shogi_load_from_sfen(Shogi *shogi, const char *sfen_cstr) {
         } else {
             Shogi_Color color = (isupper(ch)) ? SHOGI_BLACK : SHOGI_WHITE;
             Shogi_Kind kind = shogi_kind_from_char(ch);
-            if (kind < 0) {
+            if ((int) kind < 0 || x >= SHOGI_BOARD_DIM) {
                 return -1;
             }
             Shogi_Piece piece = { color, kind, promote_flag };
@@ -171,11 +333,11 @@ int shogi_load_from_sfen(Shogi *shogi, const char *sfen_cstr) {
             shogi->board[y][x].piece = piece;
             promote_flag = false;
             x += 1;
-            if (x > SHOGI_BOARD_DIM) {
-                return -1;
-            }
         }
     }
+    if (y != SHOGI_BOARD_DIM - 1 || x != SHOGI_BOARD_DIM) {
+        return -1;
+    }
 
     if (turn.size != 1) {
         return -1;
@@ -187,14 +349,33 @@ int shogi_load_from_sfen(Shogi *shogi, const char *sfen_cstr) {
         return -1;
     }
 
+    if (pieces_in_hand.size == 1 && pieces_in_hand.data[0] == '-') {
+        return 0;
+    }
+
+    int32_t count = 0;
     for (size_t i = 0; i < pieces_in_hand.size; ++i) {
         char ch = pieces_in_hand.data[i];
+        if (isdigit(ch)) {
+            count = count * 10 + (ch - '0');
+            // No kind has more than 18 pieces (pawns)
+            if (count > 18) {
+                return -1;
+            }
+            continue;
+        }
         Shogi_Color color = (isupper(ch)) ? SHOGI_BLACK : SHOGI_WHITE;
         Shogi_Kind kind = shogi_kind_from_char(ch);
-        if (kind < 0) {
+        if ((int) kind < 0) {
             return -1;
         }
-        shogi_hand_add(shogi, color, kind);
+        if (count == 0) {
+            count = 1;
+        }
+        for (int32_t j = 0; j < count; ++j) {
+            shogi_hand_add(shogi, color, kind);
+        }
+        count = 0;
     }
 
     return 0;
@@ -230,6 +411,7 @@ bool shogi_is_move_legal(Shogi *shogi, size_t from_x, size_t from_y, size_t to_x
     if (allow_king_capture) {
         return true;
     }
+    SHOGI_COUNT(SHOGI_COUNTER_LEGAL_COPIES);
     Shogi shogi_copy = *shogi;
     shogi_copy.board[to_y][to_x] = shogi_copy.board[from_y][from_x];
     shogi_copy.board[from_y][from_x].contains_piece = false;
@@ -264,6 +446,7 @@ Shogi_Mask shogi_piece_moves_at(Shogi *shogi, size_t x, size_t y, bool allow_kin
 }
 
 Shogi_Mask shogi_color_moves(Shogi *shogi, Shogi_Color color, bool allow_king_capture) {
+    SHOGI_COUNT(SHOGI_COUNTER_COLOR_MOVES);
     Shogi_Mask mask = {0};
     for (size_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
         for (size_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
@@ -311,6 +494,7 @@ Shogi_Mask shogi_walk_piece(Shogi *shogi, int32_t x, int32_t y, int32_t dirx, in
     int32_t mx = x + dirx;
     int32_t my = y + diry;
     while (shogi_can_piece_occupy(shogi, mx, my, color)) {
+        SHOGI_COUNT(SHOGI_COUNTER_WALK_STEPS);
         if (allow_king_capture || shogi_is_move_legal(shogi, x, y, mx, my, false)) {
             mask.board[my][mx] = true;
         }
@@ -454,7 +638,7 @@ Shogi_Mask shogi_drop_piece_locations(Shogi *shogi, Shogi_Color color, Shogi_Kin
             for (size_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
                 if (shogi->board[y][x].contains_piece) {
                     Shogi_Piece piece = shogi->board[y][x].piece;
-                    if (piece.kind == SHOGI_PAWN && piece.color == color) {
+                    if (piece.kind == SHOGI_PAWN && piece.color == color && !piece.is_promoted) {
                         contains_pawn = true;
                         break;
                     }
@@ -499,6 +683,7 @@ bool shogi_drop_piece(Shogi *shogi, Shogi_Color color, Shogi_Kind kind, int32_t
 }
 
 void shogi_mask_add(Shogi_Mask *dst, Shogi_Mask src) {
+    SHOGI_COUNT(SHOGI_COUNTER_MASK_ADDS);
     for (size_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
         for (size_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
             dst->board[y][x] = dst->board[y][x] || src.board[y][x];
@@ -519,4 +704,489 @@ void shogi_hand_remove(Shogi *shogi, Shogi_Color color, Shogi_Kind kind) {
     shogi->hands[color][kind] -= 1;
 }
 
+bool shogi_is_in_check(Shogi *shogi, Shogi_Color color) {
+    size_t king_x, king_y;
+    if (!shogi_find_king(shogi, color, &king_x, &king_y)) {
+        return false;
+    }
+    Shogi_Mask opponent_moves = shogi_color_moves(shogi, !color, true);
+    return opponent_moves.board[king_y][king_x];
+}
+
+bool shogi_can_promote(Shogi_Piece piece, int32_t from_y, int32_t to_y) {
+    if (piece.is_promoted || piece.kind == SHOGI_KING || piece.kind == SHOGI_GOLD) {
+        return false;
+    }
+    if (piece.color == SHOGI_BLACK) {
+        return from_y <= 2 || to_y <= 2;
+    }
+    return from_y >= SHOGI_BOARD_DIM - 3 || to_y >= SHOGI_BOARD_DIM - 3;
+}
+
+// Pieces that could never move again have to promote
+bool shogi_must_promote(Shogi_Piece piece, int32_t to_y) {
+    if (piece.is_promoted) {
+        return false;
+    }
+    int32_t rank = (piece.color == SHOGI_BLACK) ? to_y : SHOGI_BOARD_DIM - 1 - to_y;
+    if (piece.kind == SHOGI_PAWN || piece.kind == SHOGI_LANCE) {
+        return rank == 0;
+    }
+    if (piece.kind == SHOGI_KNIGHT) {
+        return rank <= 1;
+    }
+    return false;
+}
+
+// Stops at the first legal move instead of generating all of them
+bool shogi_has_legal_move(Shogi *shogi) {
+    Shogi_Color color = shogi->turn;
+    for (size_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
+        for (size_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
+            Shogi_Cell cell = shogi->board[y][x];
+            if (!cell.contains_piece || cell.piece.color != color) {
+                continue;
+            }
+            Shogi_Mask mask = shogi_piece_moves_at(shogi, x, y, false);
+            for (size_t my = 0; my < SHOGI_BOARD_DIM; ++my) {
+                for (size_t mx = 0; mx < SHOGI_BOARD_DIM; ++mx) {
+                    Shogi_Cell target = shogi->board[my][mx];
+                    if (mask.board[my][mx] && !(target.contains_piece && target.piece.kind == SHOGI_KING)) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+
+    bool in_check = shogi_is_in_check(shogi, color);
+    for (Shogi_Kind kind = SHOGI_ROOK; kind < SHOGI_KIND_COUNT; ++kind) {
+        if (shogi->hands[color][kind] <= 0) {
+            continue;
+        }
+        Shogi_Mask mask = shogi_drop_piece_locations(shogi, color, kind);
+        for (int32_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
+            for (int32_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
+                if (!mask.board[y][x]) {
+                    continue;
+                }
+                if (!in_check) {
+                    return true;
+                }
+                Shogi shogi_copy = *shogi;
+                shogi_apply_move(&shogi_copy, (Shogi_Move) { true, false, kind, 0, 0, x, y });
+                if (!shogi_is_in_check(&shogi_copy, color)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// A pawn drop only gives check when it lands right in front of the enemy king,
+// so the mate test (uchifuzume) runs for at most one square
+bool shogi_is_pawn_drop_mate(Shogi *shogi, int32_t x, int32_t y) {
+    Shogi_Color color = shogi->turn;
+    int32_t king_y = y + ((color == SHOGI_BLACK) ? -1 : 1);
+    if (king_y < 0 || king_y >= SHOGI_BOARD_DIM) {
+        return false;
+    }
+    Shogi_Cell cell = shogi->board[king_y][x];
+    if (!cell.contains_piece || cell.piece.kind != SHOGI_KING || cell.piece.color == color) {
+        return false;
+    }
+    Shogi shogi_copy = *shogi;
+    shogi_apply_move(&shogi_copy, (Shogi_Move) { true, false, SHOGI_PAWN, 0, 0, x, y });
+    return !shogi_has_legal_move(&shogi_copy);
+}
+
+// Drops can only leave the own king in check when it already was in check,
+// so the (expensive) copy-and-verify is skipped otherwise
+size_t shogi_legal_moves(Shogi *shogi, Shogi_Move *moves, size_t capacity) {
+    size_t count = 0;
+    Shogi_Color color = shogi->turn;
+
+    for (int32_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
+        for (int32_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
+            Shogi_Cell cell = shogi->board[y][x];
+            if (!cell.contains_piece || cell.piece.color != color) {
+                continue;
+            }
+            Shogi_Mask mask = shogi_piece_moves_at(shogi, x, y, false);
+            for (int32_t ty = 0; ty < SHOGI_BOARD_DIM; ++ty) {
+                for (int32_t tx = 0; tx < SHOGI_BOARD_DIM; ++tx) {
+                    if (!mask.board[ty][tx]) {
+                        continue;
+                    }
+                    Shogi_Cell target = shogi->board[ty][tx];
+                    if (target.contains_piece && target.piece.kind == SHOGI_KING) {
+                        continue;
+                    }
+                    Shogi_Move move = { false, false, 0, x, y, tx, ty };
+                    if (!shogi_must_promote(cell.piece, ty)) {
+                        if (count < capacity) moves[count++] = move;
+                    }
+                    if (shogi_can_promote(cell.piece, y, ty)) {
+                        move.promote = true;
+                        if (count < capacity) moves[count++] = move;
+                    }
+                }
+            }
+        }
+    }
+
+    bool in_check = shogi_is_in_check(shogi, color);
+    for (Shogi_Kind kind = SHOGI_ROOK; kind < SHOGI_KIND_COUNT; ++kind) {
+        if (shogi->hands[color][kind] <= 0) {
+            continue;
+        }
+        Shogi_Mask mask = shogi_drop_piece_locations(shogi, color, kind);
+        for (int32_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
+            for (int32_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
+                if (!mask.board[y][x]) {
+                    continue;
+                }
+                Shogi_Move move = { true, false, kind, 0, 0, x, y };
+                if (in_check) {
+                    Shogi shogi_copy = *shogi;
+                    shogi_apply_move(&shogi_copy, move);
+                    if (shogi_is_in_check(&shogi_copy, color)) {
+                        continue;
+                    }
+                }
+                if (kind == SHOGI_PAWN && shogi_is_pawn_drop_mate(shogi, x, y)) {
+                    continue;
+                }
+                if (count < capacity) moves[count++] = move;
+            }
+        }
+    }
+
+    return count;
+}
+
+void shogi_apply_move(Shogi *shogi, Shogi_Move move) {
+    if (move.is_drop) {
+        shogi_hand_remove(shogi, shogi->turn, move.drop_kind);
+        shogi->board[move.to_y][move.to_x].contains_piece = true;
+        shogi->board[move.to_y][move.to_x].piece = (Shogi_Piece) { shogi->turn, move.drop_kind, false };
+    } else {
+        Shogi_Cell *to = &shogi->board[move.to_y][move.to_x];
+        if (to->contains_piece) {
+            shogi_hand_add(shogi, !to->piece.color, to->piece.kind);
+        }
+        *to = shogi->board[move.from_y][move.from_x];
+        if (move.promote) {
+            to->piece.is_promoted = true;
+        }
+        shogi->board[move.from_y][move.from_x].contains_piece = false;
+    }
+    shogi->turn = !shogi->turn;
+}
+
+// 0 is an empty cell, otherwise bits 0-3 hold kind + 1, bit 4 the promotion and bit 5 the color
+uint8_t shogi_cell_encode(Shogi_Cell cell) {
+    if (!cell.contains_piece) {
+        return 0;
+    }
+    Shogi_Piece piece = cell.piece;
+    return (piece.kind + 1) | (piece.is_promoted << 4) | (piece.color << 5);
+}
+
+Shogi_Cell shogi_cell_decode(uint8_t code) {
+    Shogi_Cell cell = {0};
+    if (code == 0) {
+        return cell;
+    }
+    cell.contains_piece = true;
+    cell.piece.kind = (code & 0xF) - 1;
+    cell.piece.is_promoted = (code >> 4) & 1;
+    cell.piece.color = (code >> 5) & 1;
+    return cell;
+}
+
+uint64_t shogi_hash_mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+const int32_t shogi_piece_values[SHOGI_KIND_COUNT] = {
+    [SHOGI_KING] = 0,
+    [SHOGI_ROOK] = 1000,
+    [SHOGI_BISHOP] = 800,
+    [SHOGI_GOLD] = 500,
+    [SHOGI_SILVER] = 450,
+    [SHOGI_KNIGHT] = 300,
+    [SHOGI_LANCE] = 300,
+    [SHOGI_PAWN] = 100,
+};
+
+const int32_t shogi_promoted_values[SHOGI_KIND_COUNT] = {
+    [SHOGI_KING] = 0,
+    [SHOGI_ROOK] = 1200,
+    [SHOGI_BISHOP] = 1000,
+    [SHOGI_GOLD] = 500,
+    [SHOGI_SILVER] = 500,
+    [SHOGI_KNIGHT] = 500,
+    [SHOGI_LANCE] = 500,
+    [SHOGI_PAWN] = 500,
+};
+
+int32_t shogi_piece_value(Shogi_Piece piece) {
+    return piece.is_promoted ? shogi_promoted_values[piece.kind] : shogi_piece_values[piece.kind];
+}
+
+// Zobrist-style hash with the keys derived on the fly, so there is no table to initialize
+uint64_t shogi_hash(Shogi *shogi) {
+    uint64_t hash = 0;
+    for (size_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
+        for (size_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
+            uint8_t code = shogi_cell_encode(shogi->board[y][x]);
+            if (code != 0) {
+                hash ^= shogi_hash_mix((y * SHOGI_BOARD_DIM + x) * 64 + code);
+            }
+        }
+    }
+    for (size_t color = 0; color < SHOGI_COLOR_COUNT; ++color) {
+        for (size_t kind = 0; kind < SHOGI_KIND_COUNT; ++kind) {
+            size_t index = color * SHOGI_KIND_COUNT + kind;
+            uint64_t count = shogi->hands[color][kind];
+            hash ^= shogi_hash_mix((SHOGI_BOARD_DIM * SHOGI_BOARD_DIM + index) * 64 + count);
+        }
+    }
+    if (shogi->turn == SHOGI_WHITE) {
+        hash ^= shogi_hash_mix(UINT64_MAX);
+    }
+    return hash;
+}
+
+char shogi_char_from_kind(Shogi_Kind kind) {
+    switch (kind) {
+    case SHOGI_KING: return 'K';
+    case SHOGI_ROOK: return 'R';
+    case SHOGI_BISHOP: return 'B';
+    case SHOGI_GOLD: return 'G';
+    case SHOGI_SILVER: return 'S';
+    case SHOGI_KNIGHT: return 'N';
+    case SHOGI_LANCE: return 'L';
+    case SHOGI_PAWN: return 'P';
+    default: return '?';
+    }
+}
+
+// Writes board, side to move and hands (without a move number), returns the length
+size_t shogi_to_sfen(Shogi *shogi, char sfen[SHOGI_SFEN_CAPACITY]) {
+    size_t size = 0;
+    for (size_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
+        size_t empty = 0;
+        for (size_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
+            Shogi_Cell cell = shogi->board[y][x];
+            if (!cell.contains_piece) {
+                empty += 1;
+                continue;
+            }
+            if (empty > 0) {
+                sfen[size++] = '0' + empty;
+                empty = 0;
+            }
+            if (cell.piece.is_promoted) {
+                sfen[size++] = '+';
+            }
+            char ch = shogi_char_from_kind(cell.piece.kind);
+            sfen[size++] = (cell.piece.color == SHOGI_BLACK) ? ch : tolower(ch);
+        }
+        if (empty > 0) {
+            sfen[size++] = '0' + empty;
+        }
+        if (y + 1 < SHOGI_BOARD_DIM) {
+            sfen[size++] = '/';
+        }
+    }
+
+    sfen[size++] = ' ';
+    sfen[size++] = (shogi->turn == SHOGI_BLACK) ? 'b' : 'w';
+    sfen[size++] = ' ';
+
+    size_t hand_start = size;
+    for (size_t color = 0; color < SHOGI_COLOR_COUNT; ++color) {
+        for (Shogi_Kind kind = SHOGI_ROOK; kind < SHOGI_KIND_COUNT; ++kind) {
+            int32_t count = shogi->hands[color][kind];
+            if (count <= 0) {
+                continue;
+            }
+            if (count > 1) {
+                size += snprintf(&sfen[size], SHOGI_SFEN_CAPACITY - size, "%d", count);
+            }
+            char ch = shogi_char_from_kind(kind);
+            sfen[size++] = (color == SHOGI_BLACK) ? ch : tolower(ch);
+        }
+    }
+    if (size == hand_start) {
+        sfen[size++] = '-';
+    }
+    sfen[size] = '\0';
+    return size;
+}
+
+// USI files are numbered from the right, so file 9 is x = 0, and ranks go from 'a' at y = 0
+bool shogi_move_from_usi(Shogi_String_View usi, Shogi_Move *move) {
+    if (usi.size < 4 || usi.size > 5) {
+        return false;
+    }
+    const char *s = usi.data;
+    Shogi_Move result = {0};
+    if (s[1] == '*') {
+        result.is_drop = true;
+        result.drop_kind = shogi_kind_from_char(s[0]);
+        if ((int) result.drop_kind < 0 || result.drop_kind == SHOGI_KING || usi.size != 4) {
+            return false;
+        }
+    } else {
+        if (s[0] < '1' || s[0] > '9' || s[1] < 'a' || s[1] > 'i') {
+            return false;
+        }
+        result.from_x = SHOGI_BOARD_DIM - (s[0] - '0');
+        result.from_y = s[1] - 'a';
+    }
+    if (s[2] < '1' || s[2] > '9' || s[3] < 'a' || s[3] > 'i') {
+        return false;
+    }
+    result.to_x = SHOGI_BOARD_DIM - (s[2] - '0');
+    result.to_y = s[3] - 'a';
+    if (usi.size == 5) {
+        if (s[4] != '+') {
+            return false;
+        }
+        result.promote = true;
+    }
+    *move = result;
+    return true;
+}
+
+void shogi_move_to_usi(Shogi_Move move, char usi[6]) {
+    size_t i = 0;
+    if (move.is_drop) {
+        usi[i++] = shogi_char_from_kind(move.drop_kind);
+        usi[i++] = '*';
+    } else {
+        usi[i++] = '0' + SHOGI_BOARD_DIM - move.from_x;
+        usi[i++] = 'a' + move.from_y;
+    }
+    usi[i++] = '0' + SHOGI_BOARD_DIM - move.to_x;
+    usi[i++] = 'a' + move.to_y;
+    if (move.promote) {
+        usi[i++] = '+';
+    }
+    usi[i] = '\0';
+}
+
+#ifdef SHOGI_PROFILE
+
+#include <time.h>
+#include <stdatomic.h>
+
+_Thread_local Shogi_Profile shogi_profile = {0};
+static atomic_uint shogi_profile_thread_count = 0;
+
+const char *shogi_counter_name(Shogi_Counter counter) {
+    switch (counter) {
+    case SHOGI_COUNTER_LEGAL_COPIES: return "legal_copies";
+    case SHOGI_COUNTER_COLOR_MOVES: return "color_moves";
+    case SHOGI_COUNTER_WALK_STEPS: return "walk_steps";
+    case SHOGI_COUNTER_MASK_ADDS: return "mask_adds";
+    case SHOGI_COUNTER_SEARCH_NODES: return "search_nodes";
+    case SHOGI_COUNTER_HASH_HITS: return "hash_hits";
+    default: assert(0 && "unreachable");
+    }
+}
+
+uint64_t shogi_profile_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void shogi_profile_merge(uint64_t totals[SHOGI_COUNTER_COUNT]) {
+    for (size_t i = 0; i < SHOGI_COUNTER_COUNT; ++i) {
+        totals[i] += shogi_profile.counters[i];
+    }
+}
+
+void shogi_profile_reset(void) {
+    memset(shogi_profile.counters, 0, sizeof(shogi_profile.counters));
+    shogi_profile.event_count = 0;
+    shogi_profile.dropped_events = 0;
+}
+
+void shogi_profile_thread_init(void) {
+    if (shogi_profile.events == NULL) {
+        shogi_profile.events = malloc(sizeof(Shogi_Trace_Event) * SHOGI_TRACE_CAPACITY);
+        shogi_profile.thread_id = atomic_fetch_add(&shogi_profile_thread_count, 1);
+    }
+}
+
+// Releases the calling thread's event buffer, call it before the thread exits
+void shogi_profile_thread_free(void) {
+    free(shogi_profile.events);
+    shogi_profile.events = NULL;
+    shogi_profile.event_count = 0;
+}
+
+// Events past SHOGI_TRACE_CAPACITY are dropped (and counted) rather than
+// growing the buffer in the middle of a measurement
+void shogi_trace_record(const char *name, uint64_t start_ns) {
+    uint64_t end_ns = shogi_profile_now_ns();
+    shogi_profile_thread_init();
+    if (shogi_profile.events == NULL || shogi_profile.event_count >= SHOGI_TRACE_CAPACITY) {
+        shogi_profile.dropped_events += 1;
+        return;
+    }
+    Shogi_Trace_Event *event = &shogi_profile.events[shogi_profile.event_count++];
+    event->name = name;
+    event->start_ns = start_ns;
+    event->duration_ns = end_ns - start_ns;
+}
+
+void shogi_trace_write_begin(FILE *stream) {
+    fprintf(stream, "{\"traceEvents\":[\n");
+}
+
+// Writes the calling thread's events in Chrome trace-event format,
+// followed by a counter event with its current counters
+void shogi_trace_write_events(FILE *stream, bool *first) {
+    shogi_profile_thread_init();
+    uint32_t tid = shogi_profile.thread_id;
+    uint64_t last_ns = 0;
+    for (size_t i = 0; i < shogi_profile.event_count; ++i) {
+        Shogi_Trace_Event *event = &shogi_profile.events[i];
+        fprintf(stream, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            *first ? "" : ",\n", event->name, tid,
+            event->start_ns / 1000.0, event->duration_ns / 1000.0);
+        *first = false;
+        if (event->start_ns + event->duration_ns > last_ns) {
+            last_ns = event->start_ns + event->duration_ns;
+        }
+    }
+    if (last_ns == 0) {
+        last_ns = shogi_profile_now_ns();
+    }
+    fprintf(stream, "%s{\"name\":\"counters\",\"ph\":\"C\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"args\":{",
+        *first ? "" : ",\n", tid, last_ns / 1000.0);
+    for (size_t i = 0; i < SHOGI_COUNTER_COUNT; ++i) {
+        fprintf(stream, "%s\"%s\":%llu", (i == 0) ? "" : ",",
+            shogi_counter_name(i), (unsigned long long) shogi_profile.counters[i]);
+    }
+    fprintf(stream, ",\"dropped_events\":%zu}}", shogi_profile.dropped_events);
+    *first = false;
+}
+
+void shogi_trace_write_end(FILE *stream) {
+    fprintf(stream, "\n]}\n");
+}
+
+#endif // SHOGI_PROFILE
+
 #endif // SHOGI_IMPLEMENTATION
@@ -0,0 +1,237 @@
+#ifndef SHOGI_BATCH_H_
+#define SHOGI_BATCH_H_
+
+// Batch position analysis over structure-of-arrays storage.
+// A batch keeps every square, hand slot and the side to move in its own
+// contiguous array, indexed by position. Kernels that only read the raw
+// board (material) then sweep those arrays linearly, which the compiler can
+// vectorize. Kernels that need move generation unpack one position at a time.
+// shogi_batch_analyze splits the batch into contiguous chunks, one per thread.
+
+#include "./shogi.h"
+
+#define SHOGI_BATCH_SQUARES (SHOGI_BOARD_DIM * SHOGI_BOARD_DIM)
+
+// cells[square][i] holds shogi_cell_encode of square (y * 9 + x) of position i,
+// hands[color][kind][i] the number of pieces in hand
+typedef struct {
+    size_t count;
+    uint8_t *cells[SHOGI_BATCH_SQUARES];
+    uint8_t *hands[SHOGI_COLOR_COUNT][SHOGI_KIND_COUNT];
+    uint8_t *turn;
+    void *memory;
+} Shogi_Batch;
+
+// Any array left NULL is not computed. material is from black's point of view
+typedef struct {
+    uint16_t *legal_move_counts;
+    bool *in_check;
+    int32_t *material;
+    bool *mate_in_one;
+} Shogi_Batch_Results;
+
+bool shogi_batch_alloc(Shogi_Batch *batch, size_t count);
+void shogi_batch_free(Shogi_Batch *batch);
+void shogi_batch_store(Shogi_Batch *batch, size_t index, Shogi *shogi);
+void shogi_batch_load(const Shogi_Batch *batch, size_t index, Shogi *shogi);
+
+void shogi_batch_analyze_range(const Shogi_Batch *batch, Shogi_Batch_Results *results, size_t begin, size_t end);
+void shogi_batch_analyze(const Shogi_Batch *batch, Shogi_Batch_Results *results, size_t thread_count);
+
+bool shogi_is_mate_in_one(Shogi *shogi);
+
+#endif // SHOGI_BATCH_H_
+
+#ifdef SHOGI_BATCH_IMPLEMENTATION
+
+#include <pthread.h>
+
+// All arrays share one allocation, laid out one after the other
+bool shogi_batch_alloc(Shogi_Batch *batch, size_t count) {
+    size_t arrays = SHOGI_BATCH_SQUARES + SHOGI_COLOR_COUNT * SHOGI_KIND_COUNT + 1;
+    uint8_t *memory = calloc(arrays, count > 0 ? count : 1);
+    if (memory == NULL) {
+        return false;
+    }
+    batch->count = count;
+    batch->memory = memory;
+    for (size_t s = 0; s < SHOGI_BATCH_SQUARES; ++s) {
+        batch->cells[s] = memory;
+        memory += count;
+    }
+    for (size_t color = 0; color < SHOGI_COLOR_COUNT; ++color) {
+        for (size_t kind = 0; kind < SHOGI_KIND_COUNT; ++kind) {
+            batch->hands[color][kind] = memory;
+            memory += count;
+        }
+    }
+    batch->turn = memory;
+    return true;
+}
+
+void shogi_batch_free(Shogi_Batch *batch) {
+    free(batch->memory);
+    *batch = (Shogi_Batch) {0};
+}
+
+void shogi_batch_store(Shogi_Batch *batch, size_t index, Shogi *shogi) {
+    assert(index < batch->count);
+    for (size_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
+        for (size_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
+            batch->cells[y * SHOGI_BOARD_DIM + x][index] = shogi_cell_encode(shogi->board[y][x]);
+        }
+    }
+    for (size_t color = 0; color < SHOGI_COLOR_COUNT; ++color) {
+        for (size_t kind = 0; kind < SHOGI_KIND_COUNT; ++kind) {
+            batch->hands[color][kind][index] = shogi->hands[color][kind];
+        }
+    }
+    batch->turn[index] = shogi->turn;
+}
+
+void shogi_batch_load(const Shogi_Batch *batch, size_t index, Shogi *shogi) {
+    assert(index < batch->count);
+    for (size_t y = 0; y < SHOGI_BOARD_DIM; ++y) {
+        for (size_t x = 0; x < SHOGI_BOARD_DIM; ++x) {
+            shogi->board[y][x] = shogi_cell_decode(batch->cells[y * SHOGI_BOARD_DIM + x][index]);
+        }
+    }
+    for (size_t color = 0; color < SHOGI_COLOR_COUNT; ++color) {
+        for (size_t kind = 0; kind < SHOGI_KIND_COUNT; ++kind) {
+            shogi->hands[color][kind] = batch->hands[color][kind][index];
+        }
+    }
+    shogi->turn = batch->turn[index];
+}
+
+// Only checking moves can mate, so the reply search is skipped for the rest
+// Mating pawn drops are illegal (uchifuzume) and never come out of
+// shogi_legal_moves, so they are neither counted nor reported here
+bool shogi_is_mate_in_one(Shogi *shogi) {
+    Shogi_Move moves[SHOGI_MAX_MOVES];
+    size_t move_count = shogi_legal_moves(shogi, moves, SHOGI_MAX_MOVES);
+    for (size_t i = 0; i < move_count; ++i) {
+        Shogi child = *shogi;
+        shogi_apply_move(&child, moves[i]);
+        if (shogi_is_in_check(&child, child.turn) && !shogi_has_legal_move(&child)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The results never alias the batch arrays. Saying so with restrict parameters
+// lets the compiler vectorize these without a runtime alias check, which the
+// default -O2 cost model refuses to emit
+void shogi_batch_add_cell_values(int32_t *restrict material, const uint8_t *restrict cells, const int32_t *restrict values, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        material[i] += values[cells[i] & 63];
+    }
+}
+
+void shogi_batch_add_hand_values(int32_t *restrict material, const uint8_t *restrict black, const uint8_t *restrict white, int32_t value, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        material[i] += (black[i] - white[i]) * value;
+    }
+}
+
+void shogi_batch_analyze_range(const Shogi_Batch *batch, Shogi_Batch_Results *results, size_t begin, size_t end) {
+    if (results->material != NULL) {
+        // Indexed by shogi_cell_encode, signed for black
+        int32_t cell_values[64] = {0};
+        for (uint8_t code = 1; code < 64; ++code) {
+            Shogi_Cell cell = shogi_cell_decode(code);
+            if ((code & 0xF) != 0 && (code & 0xF) <= SHOGI_KIND_COUNT) {
+                int32_t value = shogi_piece_value(cell.piece);
+                cell_values[code] = (cell.piece.color == SHOGI_BLACK) ? value : -value;
+            }
+        }
+
+        size_t count = end - begin;
+        int32_t *material = results->material + begin;
+        memset(material, 0, sizeof(int32_t) * count);
+        for (size_t s = 0; s < SHOGI_BATCH_SQUARES; ++s) {
+            shogi_batch_add_cell_values(material, batch->cells[s] + begin, cell_values, count);
+        }
+        for (size_t kind = 0; kind < SHOGI_KIND_COUNT; ++kind) {
+            shogi_batch_add_hand_values(material,
+                batch->hands[SHOGI_BLACK][kind] + begin,
+                batch->hands[SHOGI_WHITE][kind] + begin,
+                shogi_piece_values[kind], count);
+        }
+    }
+
+    if (results->legal_move_counts == NULL && results->in_check == NULL && results->mate_in_one == NULL) {
+        return;
+    }
+    Shogi_Move moves[SHOGI_MAX_MOVES];
+    for (size_t i = begin; i < end; ++i) {
+        Shogi shogi;
+        shogi_batch_load(batch, i, &shogi);
+        if (results->legal_move_counts != NULL) {
+            results->legal_move_counts[i] = shogi_legal_moves(&shogi, moves, SHOGI_MAX_MOVES);
+        }
+        if (results->in_check != NULL) {
+            results->in_check[i] = shogi_is_in_check(&shogi, shogi.turn);
+        }
+        if (results->mate_in_one != NULL) {
+            results->mate_in_one[i] = shogi_is_mate_in_one(&shogi);
+        }
+    }
+}
+
+typedef struct {
+    const Shogi_Batch *batch;
+    Shogi_Batch_Results *results;
+    size_t begin;
+    size_t end;
+    pthread_t thread;
+    bool spawned;
+} Shogi_Batch_Chunk;
+
+void *shogi_batch_chunk_run(void *arg) {
+    Shogi_Batch_Chunk *chunk = arg;
+    shogi_batch_analyze_range(chunk->batch, chunk->results, chunk->begin, chunk->end);
+    return NULL;
+}
+
+// The calling thread takes the first chunk itself; if a thread can't be
+// spawned its chunk is run inline as well
+void shogi_batch_analyze(const Shogi_Batch *batch, Shogi_Batch_Results *results, size_t thread_count) {
+    if (thread_count > batch->count) {
+        thread_count = batch->count;
+    }
+    if (thread_count <= 1) {
+        shogi_batch_analyze_range(batch, results, 0, batch->count);
+        return;
+    }
+
+    // Without memory for the chunks the whole batch runs on the calling thread
+    Shogi_Batch_Chunk *chunks = malloc(sizeof(Shogi_Batch_Chunk) * thread_count);
+    if (chunks == NULL) {
+        shogi_batch_analyze_range(batch, results, 0, batch->count);
+        return;
+    }
+    for (size_t t = 0; t < thread_count; ++t) {
+        chunks[t] = (Shogi_Batch_Chunk) {
+            .batch = batch,
+            .results = results,
+            .begin = batch->count * t / thread_count,
+            .end = batch->count * (t + 1) / thread_count,
+        };
+    }
+    for (size_t t = 1; t < thread_count; ++t) {
+        chunks[t].spawned = pthread_create(&chunks[t].thread, NULL, shogi_batch_chunk_run, &chunks[t]) == 0;
+    }
+    shogi_batch_chunk_run(&chunks[0]);
+    for (size_t t = 1; t < thread_count; ++t) {
+        if (chunks[t].spawned) {
+            pthread_join(chunks[t].thread, NULL);
+        } else {
+            shogi_batch_chunk_run(&chunks[t]);
+        }
+    }
+    free(chunks);
+}
+
+#endif // SHOGI_BATCH_IMPLEMENTATION
@@ -0,0 +1,173 @@
+#ifndef SHOGI_BOOK_H_
+#define SHOGI_BOOK_H_
+
+// Opening book stored as a sorted array of fixed size entries.
+// The file is memory-mapped read-only and queried in place, so opening a book
+// does no parsing and a probe returns a pointer straight into the mapping.
+//
+// File layout (native endianness):
+//   Shogi_Book_Header
+//   Shogi_Book_Entry[count], sorted by (key, move)
+
+#include "./shogi.h"
+
+#define SHOGI_BOOK_MAGIC "SHOGIBK1"
+
+typedef struct {
+    char magic[8];
+    uint64_t count;
+} Shogi_Book_Header;
+
+// move is encoded with shogi_book_move_encode, wins/draws/losses are from the
+// point of view of the side playing the move
+typedef struct {
+    uint64_t key;
+    uint16_t move;
+    uint16_t weight;
+    uint32_t wins;
+    uint32_t draws;
+    uint32_t losses;
+} Shogi_Book_Entry;
+
+typedef struct {
+    const Shogi_Book_Entry *entries;
+    size_t count;
+    void *map;
+    size_t map_size;
+} Shogi_Book;
+
+bool shogi_book_open(Shogi_Book *book, const char *path);
+void shogi_book_close(Shogi_Book *book);
+size_t shogi_book_probe(const Shogi_Book *book, uint64_t key, const Shogi_Book_Entry **entries);
+
+uint16_t shogi_book_move_encode(Shogi_Move move);
+Shogi_Move shogi_book_move_decode(uint16_t code);
+int shogi_book_entry_compare(const void *a, const void *b);
+
+#endif // SHOGI_BOOK_H_
+
+#ifdef SHOGI_BOOK_IMPLEMENTATION
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+bool shogi_book_open(Shogi_Book *book, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(Shogi_Book_Header)) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    const Shogi_Book_Header *header = map;
+    size_t count = header->count;
+    if (memcmp(header->magic, SHOGI_BOOK_MAGIC, sizeof(header->magic)) != 0 ||
+        count > (st.st_size - sizeof(Shogi_Book_Header)) / sizeof(Shogi_Book_Entry))
+    {
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    book->entries = (const Shogi_Book_Entry *) (header + 1);
+    book->count = count;
+    book->map = map;
+    book->map_size = st.st_size;
+    return true;
+}
+
+void shogi_book_close(Shogi_Book *book) {
+    if (book->map != NULL) {
+        munmap(book->map, book->map_size);
+    }
+    *book = (Shogi_Book) {0};
+}
+
+// Keys are hashes and therefore close to uniformly distributed, so a few
+// interpolation steps land next to the target; binary search finishes the job
+// and bounds the worst case
+size_t shogi_book_probe(const Shogi_Book *book, uint64_t key, const Shogi_Book_Entry **entries) {
+    const Shogi_Book_Entry *e = book->entries;
+    size_t lo = 0;
+    size_t hi = book->count;
+    for (size_t step = 0; hi - lo > 16 && step < 8; ++step) {
+        uint64_t klo = e[lo].key;
+        uint64_t khi = e[hi - 1].key;
+        if (key <= klo) {
+            hi = lo;
+            break;
+        }
+        if (key > khi) {
+            lo = hi;
+            break;
+        }
+        double t = (double) (key - klo) / (double) (khi - klo);
+        size_t mid = lo + (size_t) (t * (hi - 1 - lo));
+        if (e[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (e[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    size_t count = 0;
+    while (lo + count < book->count && e[lo + count].key == key) {
+        count += 1;
+    }
+    *entries = &e[lo];
+    return count;
+}
+
+// bits 0-6 hold the destination square, bits 7-13 the source square or
+// 81 + kind for drops, and bit 14 the promotion
+uint16_t shogi_book_move_encode(Shogi_Move move) {
+    uint16_t to = move.to_y * SHOGI_BOARD_DIM + move.to_x;
+    uint16_t from = move.is_drop
+        ? (uint16_t) (SHOGI_BOARD_DIM * SHOGI_BOARD_DIM + move.drop_kind)
+        : (uint16_t) (move.from_y * SHOGI_BOARD_DIM + move.from_x);
+    return to | (from << 7) | (move.promote << 14);
+}
+
+Shogi_Move shogi_book_move_decode(uint16_t code) {
+    Shogi_Move move = {0};
+    uint16_t to = code & 0x7F;
+    uint16_t from = (code >> 7) & 0x7F;
+    move.to_x = to % SHOGI_BOARD_DIM;
+    move.to_y = to / SHOGI_BOARD_DIM;
+    if (from >= SHOGI_BOARD_DIM * SHOGI_BOARD_DIM) {
+        move.is_drop = true;
+        move.drop_kind = from - SHOGI_BOARD_DIM * SHOGI_BOARD_DIM;
+    } else {
+        move.from_x = from % SHOGI_BOARD_DIM;
+        move.from_y = from / SHOGI_BOARD_DIM;
+    }
+    move.promote = (code >> 14) & 1;
+    return move;
+}
+
+int shogi_book_entry_compare(const void *a, const void *b) {
+    const Shogi_Book_Entry *ea = a;
+    const Shogi_Book_Entry *eb = b;
+    if (ea->key != eb->key) return (ea->key < eb->key) ? -1 : 1;
+    if (ea->move != eb->move) return (ea->move < eb->move) ? -1 : 1;
+    return 0;
+}
+
+#endif // SHOGI_BOOK_IMPLEMENTATION